@@ -0,0 +1,378 @@
+/* Core benchmark: times each stage between reading a document and drawing
+ * it, and reports tokens/s, bytes/s and peak RSS per document. Documents
+ * come from the generator or from files, e.g. ones written by gen_json:
+ *
+ *   build/bench_core                        every shape at 16 MiB
+ *   build/bench_core --size 256M deep       one shape at another size
+ *   build/bench_core /tmp/wide.json         a file, read like the viewer does
+ *   build/bench_core --threads 1 wide       viewer_init without parallel rounds
+ *   build/bench_core --verify --size 24M    parallel rounds against jsmn alone
+ *
+ * The render stage formats every line the viewer would lay out, as
+ * display_json does for the rows on screen; it counts lines, not tokens,
+ * and bytes of formatted text.
+ *
+ * --verify benchmarks nothing. It parses every document with one thread
+ * and in parallel rounds of --threads threads, 4 unless given, and checks
+ * that tokens, parent links, depths, subtree ends and flags all come out
+ * the same; so do the errors for the document cut short and with a stray
+ * bracket in the middle. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+#include "format.h"
+#include "generate.h"
+#include "json_parallel.h"
+#include "ndjson.h"
+#include "search.h"
+#include "viewer.h"
+
+#define DEFAULT_SIZE "16M"
+#define READ_CHUNK_BYTES (1 << 20)
+/* Searched for in every document: a text term and a path that visits
+ * every node */
+#define TEXT_TERM "item-1"
+#define PATH_TERM "$..*"
+#define VERIFY_THREADS 4
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Start measuring peak RSS afresh; Linux only, elsewhere the peak of the
+ * whole run is reported */
+static void reset_peak_rss(void) {
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (!f) return;
+    fputs("5", f);
+    fclose(f);
+}
+
+static long peak_rss_kb(void) {
+    FILE *f = fopen("/proc/self/status", "r");
+    char line[256];
+    long kb = -1;
+
+    while (f && fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "VmHWM: %ld kB", &kb) == 1) break;
+    }
+    if (f) fclose(f);
+    if (kb >= 0) return kb;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static void report(const char *stage, double ms, long long items, size_t bytes) {
+    if (ms <= 0) ms = 1e-3;
+    printf("  %-16s %10.2f %12lld %10.2f %10.1f\n",
+           stage, ms, items, items / ms / 1e3, bytes / ms / 1e3);
+}
+
+static int search(JsonViewer *viewer, const char *term) {
+    snprintf(viewer->search_term, sizeof(viewer->search_term), "%s", term);
+    if (search_start(viewer, NULL) < 0) return -1;
+    search_wait(viewer);
+    return viewer->search_match_count;
+}
+
+/* Format every line, as if scrolling through the whole document */
+static size_t render(const JsonViewer *viewer) {
+    char buf[512];
+    size_t bytes = 0;
+
+    for (int line = 0; line < viewer->lines.total; line++) {
+        if (viewer->ndjson) {
+            JsonViewer *doc;
+            int tok;
+            int record = ndjson_line(viewer, line, &doc, &tok);
+            if (doc) {
+                format_record_line(viewer, record, doc, tok, buf, sizeof(buf));
+            } else {
+                format_record(viewer, record, buf, sizeof(buf));
+            }
+        } else {
+            format_line(viewer, visible_lines_token(&viewer->lines, line), buf, sizeof(buf));
+        }
+        bytes += strlen(buf);
+    }
+    return bytes;
+}
+
+/* The tokenizer and depth pass on their own, then everything viewer_init
+ * does on top: the structural index and the visible lines */
+static int load_document(JsonViewer *viewer, JsonSource *source) {
+    jsmntok_t *tokens = NULL;
+    int *parents = NULL;
+
+    double t0 = now_ms();
+    int count = parse_tokens(source->data, source->len, &tokens, &parents);
+    double t1 = now_ms();
+    if (count < 0) {
+        fprintf(stderr, "Failed to parse JSON: %d\n", count);
+        return -1;
+    }
+    report("jsmn_parse", t1 - t0, count, source->len);
+
+    uint16_t *depths = malloc(sizeof(uint16_t) * (count > 0 ? count : 1));
+    if (!depths) {
+        free(parents);
+        free(tokens);
+        return -1;
+    }
+    t0 = now_ms();
+    calculate_depths(tokens, count, parents, depths);
+    t1 = now_ms();
+    report("calculate_depths", t1 - t0, count, source->len);
+    free(depths);
+    free(parents);
+    free(tokens);
+
+    t0 = now_ms();
+    if (viewer_init(viewer, source->data, source->len) < 0) return -1;
+    t1 = now_ms();
+    report("viewer_init", t1 - t0, viewer->token_count, source->len);
+
+    VisibleLines lines;
+    t0 = now_ms();
+    if (visible_lines_init(&lines, &viewer->index, viewer->collapsed) < 0) {
+        viewer_cleanup(viewer);
+        return -1;
+    }
+    t1 = now_ms();
+    report("visible_lines", t1 - t0, viewer->token_count, source->len);
+    visible_lines_free(&lines);
+    return viewer->token_count;
+}
+
+/* Finding the records, then parsing every one of them */
+static long long load_records(JsonViewer *viewer, JsonSource *source) {
+    double t0 = now_ms();
+    if (viewer_open_records(viewer, source) < 0) return -1;
+    int result = viewer_wait(viewer);
+    double t1 = now_ms();
+    if (result < 0) {
+        fprintf(stderr, "Failed to index records: %d\n", result);
+        viewer_cleanup(viewer);
+        return -1;
+    }
+    report("scan_records", t1 - t0, viewer->ndjson->count, source->len);
+
+    NdjsonScratch scratch;
+    long long tokens = 0;
+    ndjson_scratch_init(&scratch);
+    t0 = now_ms();
+    for (int record = 0; record < viewer->ndjson->count; record++) {
+        int count = ndjson_scratch_parse(&scratch, viewer, record);
+        if (count > 0) tokens += count;
+    }
+    t1 = now_ms();
+    ndjson_scratch_free(&scratch);
+    report("parse_records", t1 - t0, tokens, source->len);
+    return tokens;
+}
+
+static int bench_document(const char *name, JsonSource *source, int records) {
+    JsonViewer viewer;
+
+    printf("%s: %.1f MB%s, %d threads\n", name, source->len / 1e6, records ? ", JSON Lines" : "",
+           json_parallel_threads());
+    printf("  %-16s %10s %12s %10s %10s\n", "stage", "ms", "items", "M/s", "MB/s");
+    reset_peak_rss();
+
+    long long tokens = records ? load_records(&viewer, source) : load_document(&viewer, source);
+    if (tokens < 0) return -1;
+
+    const char *terms[] = { TEXT_TERM, PATH_TERM };
+    for (int i = 0; i < 2; i++) {
+        char stage[32];
+        double t0 = now_ms();
+        int matches = search(&viewer, terms[i]);
+        double t1 = now_ms();
+        snprintf(stage, sizeof(stage), "search %s", terms[i]);
+        if (matches < 0) {
+            fprintf(stderr, "Search for %s failed\n", terms[i]);
+        } else {
+            report(stage, t1 - t0, tokens, source->len);
+        }
+    }
+
+    double t0 = now_ms();
+    size_t bytes = render(&viewer);
+    double t1 = now_ms();
+    report("render", t1 - t0, viewer.lines.total, bytes);
+
+    printf("  peak RSS %.1f MB\n\n", peak_rss_kb() / 1024.0);
+    viewer_cleanup(&viewer);
+    return 0;
+}
+
+/* Whether two parses of the same text agree on every table */
+static int same_tables(const JsonViewer *a, const JsonViewer *b) {
+    if (a->token_count != b->token_count) return 0;
+
+    for (int i = 0; i < a->token_count; i++) {
+        const jsmntok_t *x = &a->tokens[i], *y = &b->tokens[i];
+        if (x->start != y->start || x->end != y->end || x->type != y->type || x->size != y->size ||
+            a->index.parents[i] != b->index.parents[i] ||
+            a->index.next[i] != b->index.next[i] ||
+            a->index.nodes[i] != b->index.nodes[i]) {
+            fprintf(stderr, "  token %d differs\n", i);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Parse once with a single thread and once in parallel rounds. Returns 0
+ * if both agree, with the parallel rounds kept for a document that
+ * parses. */
+static int verify_parse(const char *name, const char *what, const char *data, size_t len,
+                        int threads) {
+    JsonViewer sequential, parallel;
+
+    json_parallel_set_threads(1);
+    int expected = viewer_parse(&sequential, data, len);
+    json_parallel_set_threads(threads);
+    int result = viewer_parse(&parallel, data, len);
+
+    int ok = result == expected;
+    if (!ok) {
+        fprintf(stderr, "  %s: %d with one thread, %d in parallel\n", what, expected, result);
+    } else if (result == 0) {
+        ok = same_tables(&sequential, &parallel);
+        if (ok && !parallel.parallel) {
+            fprintf(stderr, "  %s: fell back to one thread\n", what);
+            ok = 0;
+        }
+    }
+    if (expected == 0) viewer_cleanup(&sequential);
+    if (result == 0) viewer_cleanup(&parallel);
+
+    printf("%s %s: %s\n", name, what, ok ? "same" : "DIFFERENT");
+    return ok ? 0 : -1;
+}
+
+static int verify_document(const char *name, JsonSource *source, int threads) {
+    size_t len = source->len;
+    int failed = verify_parse(name, "intact", source->data, len, threads) < 0;
+
+    failed |= verify_parse(name, "truncated", source->data, len - len / 4, threads) < 0;
+
+    char *broken = malloc(len ? len : 1);
+    if (!broken) return -1;
+    memcpy(broken, source->data, len);
+    if (len > 0) broken[len / 2] = ']';
+    failed |= verify_parse(name, "stray bracket", broken, len, threads) < 0;
+    free(broken);
+
+    json_parallel_set_threads(threads);
+    return failed ? -1 : 0;
+}
+
+/* Benchmark a document, or with verify_threads check its parallel parse */
+static int run_document(const char *name, JsonSource *source, int records, int verify_threads) {
+    if (verify_threads) return verify_document(name, source, verify_threads);
+    return bench_document(name, source, records);
+}
+
+/* A generated document, handed over as if read from a pipe */
+static int bench_shape(GenShape shape, size_t size, int verify_threads) {
+    JsonSource source;
+    size_t len;
+    char *data = gen_document_alloc(shape, size, GEN_DEFAULT_SEED, &len);
+    if (!data) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return -1;
+    }
+
+    memset(&source, 0, sizeof(source));
+    source.data = data;
+    source.len = len;
+    source.capacity = len;
+    source.fd = -1;
+    source.detected = 1;
+
+    int result = run_document(gen_shape_name(shape), &source, shape == GEN_NDJSON, verify_threads);
+    json_source_close(&source);
+    return result;
+}
+
+static int bench_file(const char *path, int verify_threads) {
+    JsonSource source;
+    if (json_source_open(&source, path) < 0) {
+        perror(path);
+        return -1;
+    }
+
+    // Streams and compressed files are read to the end first
+    while (source.fd >= 0) {
+        if (json_source_reserve(&source, READ_CHUNK_BYTES) < 0 ||
+            json_source_read(&source, READ_CHUNK_BYTES, NULL) < 0) {
+            perror(path);
+            json_source_close(&source);
+            return -1;
+        }
+    }
+
+    int result = run_document(path, &source, ndjson_path_matches(path), verify_threads);
+    json_source_close(&source);
+    return result;
+}
+
+int main(int argc, char **argv) {
+    size_t size = gen_parse_size(DEFAULT_SIZE);
+    int shapes[GEN_SHAPES];
+    int shape_count = 0;
+    int files = 0;
+    int failed = 0;
+    int verify = 0;
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            size = gen_parse_size(argv[++i]);
+            if (size == 0) {
+                fprintf(stderr, "Invalid size: %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            json_parallel_set_threads(threads);
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            verify = 1;
+        } else if (gen_shape_parse(argv[i]) >= 0) {
+            if (shape_count < GEN_SHAPES) shapes[shape_count++] = gen_shape_parse(argv[i]);
+        } else {
+            files++;
+        }
+    }
+
+    // Verifying takes more than one thread even on a single CPU
+    int verify_threads = !verify ? 0 : threads > 1 ? threads : VERIFY_THREADS;
+
+    // Files first, then the generated shapes
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--size") == 0 || strcmp(argv[i], "--threads") == 0) {
+            i++;
+        } else if (strcmp(argv[i], "--verify") != 0 && gen_shape_parse(argv[i]) < 0) {
+            failed |= bench_file(argv[i], verify_threads) < 0;
+        }
+    }
+    if (shape_count == 0 && files == 0) {
+        for (int i = 0; i < GEN_SHAPES; i++) {
+            shapes[shape_count++] = i;
+        }
+    }
+    for (int i = 0; i < shape_count; i++) {
+        failed |= bench_shape(shapes[i], size, verify_threads) < 0;
+    }
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,80 @@
+/* Startup benchmark: times parse_tokens and calculate_depths on synthetic
+ * documents of doubling size. Linear scaling shows up as a flat ns/token
+ * column. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "json_index.h"
+
+#define MIN_RECORDS 4096
+#define MAX_RECORDS (1 << 20)
+
+/* Each record is {"id":N,"name":"itemN","tags":["a","b"],"pos":{"x":N,"y":N}} */
+static char *generate_document(int records, size_t *out_len) {
+    size_t cap = (size_t)records * 96 + 16;
+    char *buf = malloc(cap);
+    if (!buf) return NULL;
+
+    size_t len = 0;
+    buf[len++] = '[';
+    for (int i = 0; i < records; i++) {
+        len += snprintf(buf + len, cap - len,
+                        "%s{\"id\":%d,\"name\":\"item%d\",\"tags\":[\"a\",\"b\"],"
+                        "\"pos\":{\"x\":%d,\"y\":%d}}",
+                        i ? "," : "", i, i, i % 1000, i / 1000);
+    }
+    buf[len++] = ']';
+    buf[len] = '\0';
+
+    *out_len = len;
+    return buf;
+}
+
+static double now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main(void) {
+    printf("%10s %12s %12s %12s %12s %12s\n",
+           "tokens", "bytes", "parse ms", "depths ms", "parse ns/t", "depths ns/t");
+
+    for (int records = MIN_RECORDS; records <= MAX_RECORDS; records *= 2) {
+        size_t len;
+        char *json = generate_document(records, &len);
+        if (!json) {
+            fprintf(stderr, "Memory allocation failed\n");
+            return 1;
+        }
+
+        jsmntok_t *tokens = NULL;
+        int *parents = NULL;
+        double t0 = now_ms();
+        int count = parse_tokens(json, len, &tokens, &parents);
+        double t1 = now_ms();
+        if (count < 0) {
+            fprintf(stderr, "Failed to parse JSON: %d\n", count);
+            free(json);
+            return 1;
+        }
+
+        uint16_t *depths = malloc(sizeof(uint16_t) * count);
+        double t2 = now_ms();
+        calculate_depths(tokens, count, parents, depths);
+        double t3 = now_ms();
+
+        printf("%10d %12zu %12.2f %12.2f %12.1f %12.1f\n",
+               count, len, t1 - t0, t3 - t2,
+               (t1 - t0) * 1e6 / count, (t3 - t2) * 1e6 / count);
+
+        free(depths);
+        free(parents);
+        free(tokens);
+        free(json);
+    }
+
+    return 0;
+}
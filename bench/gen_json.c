@@ -0,0 +1,46 @@
+/* Synthetic document generator: writes a deterministic document of the
+ * given shape and size to standard output, for benchmarks on inputs
+ * too large to keep in memory, e.g.
+ *
+ *   build/gen_json wide 10G > /tmp/wide.json
+ *   build/gen_json ndjson 1G 7 | gzip > /tmp/records.jsonl.gz
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "generate.h"
+
+static int write_all(void *ctx, const char *data, size_t len) {
+    int fd = *(int *)ctx;
+
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int shape = argc > 2 ? gen_shape_parse(argv[1]) : -1;
+    size_t size = argc > 2 ? gen_parse_size(argv[2]) : 0;
+    uint64_t seed = argc > 3 ? strtoull(argv[3], NULL, 10) : GEN_DEFAULT_SEED;
+
+    if (shape < 0 || size == 0 || argc > 4) {
+        fprintf(stderr, "Usage: %s <wide|deep|strings|ndjson> <size>[K|M|G] [seed]\n", argv[0]);
+        return 1;
+    }
+
+    int fd = STDOUT_FILENO;
+    if (gen_document(shape, size, seed, write_all, &fd) < 0) {
+        perror("write");
+        return 1;
+    }
+    return 0;
+}
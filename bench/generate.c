@@ -0,0 +1,212 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "generate.h"
+
+/* Output is handed to the sink in blocks of this size */
+#define GEN_BLOCK_BYTES (64 << 10)
+/* Room kept free for one formatted piece */
+#define GEN_PIECE_MAX 256
+
+#define WIDE_MEMBERS 16
+#define DEEP_MIN_LEVELS 16
+#define DEEP_MAX_LEVELS 512
+#define STRING_MAX_CHARS 2048
+
+static const char *const shape_names[GEN_SHAPES] = { "wide", "deep", "strings", "ndjson" };
+
+typedef struct {
+    char buf[GEN_BLOCK_BYTES];
+    size_t len;
+    size_t total;
+    uint64_t rng;
+    GenSink sink;
+    void *ctx;
+    int stopped;
+} Gen;
+
+/* xorshift64*, good enough to vary the shapes and fully reproducible */
+static uint64_t next_random(Gen *gen) {
+    gen->rng ^= gen->rng >> 12;
+    gen->rng ^= gen->rng << 25;
+    gen->rng ^= gen->rng >> 27;
+    return gen->rng * 0x2545F4914F6CDD1DULL;
+}
+
+static int random_below(Gen *gen, int n) {
+    return (int)(next_random(gen) % (uint64_t)n);
+}
+
+static void flush(Gen *gen) {
+    if (gen->len > 0 && !gen->stopped && gen->sink(gen->ctx, gen->buf, gen->len) < 0) {
+        gen->stopped = 1;
+    }
+    gen->total += gen->len;
+    gen->len = 0;
+}
+
+static void put_char(Gen *gen, char c) {
+    if (gen->len == GEN_BLOCK_BYTES) flush(gen);
+    gen->buf[gen->len++] = c;
+}
+
+static void put_format(Gen *gen, const char *format, ...) {
+    va_list args;
+
+    if (gen->len + GEN_PIECE_MAX > GEN_BLOCK_BYTES) flush(gen);
+    va_start(args, format);
+    gen->len += vsnprintf(gen->buf + gen->len, GEN_PIECE_MAX, format, args);
+    va_end(args);
+}
+
+static size_t written(const Gen *gen) {
+    return gen->total + gen->len;
+}
+
+/* {"id":N,"name":"item-N","active":true,"score":1.5,"tags":[...],"f0":N,...} */
+static void wide_object(Gen *gen, long long id) {
+    put_format(gen, "{\"id\":%lld,\"name\":\"item-%lld\",\"active\":%s,\"score\":%d.%02d,\"tags\":[",
+               id, id, random_below(gen, 2) ? "true" : "false",
+               random_below(gen, 1000), random_below(gen, 100));
+    int tags = random_below(gen, 5);
+    for (int i = 0; i < tags; i++) {
+        put_format(gen, "%s\"t%d\"", i ? "," : "", random_below(gen, 50));
+    }
+    put_format(gen, "]");
+    for (int i = 0; i < WIDE_MEMBERS; i++) {
+        put_format(gen, ",\"f%d\":%d", i, random_below(gen, 100000));
+    }
+    put_format(gen, ",\"note\":null}");
+}
+
+/* Objects and arrays alternating down to a random depth */
+static void deep_value(Gen *gen, long long id) {
+    int levels = DEEP_MIN_LEVELS + random_below(gen, DEEP_MAX_LEVELS - DEEP_MIN_LEVELS + 1);
+
+    for (int i = 0; i < levels; i++) {
+        if (i & 1) {
+            put_format(gen, "[%d,", i);
+        } else {
+            put_format(gen, "{\"level\":%d,\"child\":", i);
+        }
+    }
+    put_format(gen, "%lld", id);
+    for (int i = levels - 1; i >= 0; i--) {
+        put_char(gen, (i & 1) ? ']' : '}');
+    }
+}
+
+/* Mostly letters and spaces, with the escapes a real payload has */
+static void long_string(Gen *gen) {
+    static const char *const escapes[] = { "\\\"", "\\\\", "\\n", "\\t", "\\u00e9", "\\/" };
+    int chars = 1 + random_below(gen, STRING_MAX_CHARS);
+
+    put_char(gen, '"');
+    for (int i = 0; i < chars; i++) {
+        int r = random_below(gen, 64);
+        if (r == 0) {
+            put_format(gen, "%s", escapes[random_below(gen, 6)]);
+        } else if (r < 10) {
+            put_char(gen, ' ');
+        } else {
+            put_char(gen, 'a' + random_below(gen, 26));
+        }
+    }
+    put_char(gen, '"');
+}
+
+int gen_shape_parse(const char *name) {
+    for (int i = 0; i < GEN_SHAPES; i++) {
+        if (strcmp(name, shape_names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+const char *gen_shape_name(GenShape shape) {
+    return shape_names[shape];
+}
+
+size_t gen_parse_size(const char *text) {
+    char *end;
+    double value = strtod(text, &end);
+    size_t unit = 1;
+
+    if (*end == 'K' || *end == 'k') unit = (size_t)1 << 10;
+    if (*end == 'M' || *end == 'm') unit = (size_t)1 << 20;
+    if (*end == 'G' || *end == 'g') unit = (size_t)1 << 30;
+    if (unit > 1) end++;
+    if (end == text || *end || value <= 0) return 0;
+    return (size_t)(value * unit);
+}
+
+int gen_document(GenShape shape, size_t size, uint64_t seed, GenSink sink, void *ctx) {
+    Gen *gen = malloc(sizeof(Gen));
+    if (!gen) return -1;
+
+    gen->len = 0;
+    gen->total = 0;
+    gen->rng = seed ? seed : GEN_DEFAULT_SEED;
+    gen->sink = sink;
+    gen->ctx = ctx;
+    gen->stopped = 0;
+
+    if (shape != GEN_NDJSON) put_char(gen, '[');
+    for (long long id = 0; written(gen) < size && !gen->stopped; id++) {
+        if (shape == GEN_NDJSON) {
+            wide_object(gen, id);
+            put_char(gen, '\n');
+            continue;
+        }
+        if (id > 0) put_char(gen, ',');
+        if (shape == GEN_WIDE) {
+            wide_object(gen, id);
+        } else if (shape == GEN_DEEP) {
+            deep_value(gen, id);
+        } else {
+            long_string(gen);
+        }
+    }
+    if (shape != GEN_NDJSON) put_char(gen, ']');
+    flush(gen);
+
+    int result = gen->stopped ? -1 : 0;
+    free(gen);
+    return result;
+}
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t capacity;
+} GenBuffer;
+
+static int append(void *ctx, const char *data, size_t len) {
+    GenBuffer *buffer = ctx;
+
+    if (buffer->len + len > buffer->capacity) {
+        size_t capacity = buffer->capacity * 2 > buffer->len + len ? buffer->capacity * 2
+                                                                   : buffer->len + len;
+        char *grown = realloc(buffer->data, capacity);
+        if (!grown) return -1;
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->len, data, len);
+    buffer->len += len;
+    return 0;
+}
+
+char *gen_document_alloc(GenShape shape, size_t size, uint64_t seed, size_t *len) {
+    // The last item overshoots the size by at most a few kilobytes
+    GenBuffer buffer = { malloc(size + GEN_BLOCK_BYTES), 0, size + GEN_BLOCK_BYTES };
+    if (!buffer.data) return NULL;
+
+    if (gen_document(shape, size, seed, append, &buffer) < 0) {
+        free(buffer.data);
+        return NULL;
+    }
+    *len = buffer.len;
+    return buffer.data;
+}
@@ -0,0 +1,37 @@
+#ifndef GENERATE_H
+#define GENERATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Deterministic synthetic documents for the benchmarks. The same shape,
+ * size and seed always give the same bytes. */
+typedef enum {
+    GEN_WIDE,       /* array of flat objects with many members */
+    GEN_DEEP,       /* array of objects and arrays nested hundreds deep */
+    GEN_STRINGS,    /* array of long strings with escapes */
+    GEN_NDJSON,     /* one wide object per line */
+    GEN_SHAPES
+} GenShape;
+
+#define GEN_DEFAULT_SEED 1
+
+/* Receives the document a block at a time. Returns 0, or -1 to stop. */
+typedef int (*GenSink)(void *ctx, const char *data, size_t len);
+
+/* Shape called name, or -1 */
+int gen_shape_parse(const char *name);
+const char *gen_shape_name(GenShape shape);
+
+/* Byte count such as 512K, 16M or 10G; 0 if it does not parse */
+size_t gen_parse_size(const char *text);
+
+/* Write a document of about size bytes, never less, to sink. Returns 0,
+ * or -1 if the sink stopped it. */
+int gen_document(GenShape shape, size_t size, uint64_t seed, GenSink sink, void *ctx);
+
+/* The same into a heap buffer, which the caller frees. NULL if out of
+ * memory. */
+char *gen_document_alloc(GenShape shape, size_t size, uint64_t seed, size_t *len);
+
+#endif /* GENERATE_H */
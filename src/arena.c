@@ -0,0 +1,60 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+/* Huge pages only pay off once a table spans several of them */
+#define ARENA_HUGE_MIN ((size_t)8 << 20)
+
+void arena_init(Arena *arena) {
+    arena->base = NULL;
+    arena->size = 0;
+    arena->used = 0;
+    arena->mapped = 0;
+}
+
+int arena_reserve(Arena *arena, size_t size) {
+    arena_init(arena);
+    if (size == 0) size = ARENA_ALIGN;
+
+    if (size < ARENA_MAP_MIN) {
+        void *block;
+        if (posix_memalign(&block, ARENA_ALIGN, size) != 0) return -1;
+        memset(block, 0, size);
+        arena->base = block;
+    } else {
+        // Address space only: the system commits pages as they are written
+        void *map = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (map == MAP_FAILED) return -1;
+#ifdef MADV_HUGEPAGE
+        if (size >= ARENA_HUGE_MIN) {
+            madvise(map, size, MADV_HUGEPAGE);
+        }
+#endif
+        arena->base = map;
+        arena->mapped = 1;
+    }
+
+    arena->size = size;
+    return 0;
+}
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size_t rounded = arena_round(size);
+    if (rounded > arena->size - arena->used) return NULL;
+
+    void *ptr = arena->base + arena->used;
+    arena->used += rounded;
+    return ptr;
+}
+
+void arena_free(Arena *arena) {
+    if (arena->mapped) {
+        munmap(arena->base, arena->size);
+    } else {
+        free(arena->base);
+    }
+    arena_init(arena);
+}
@@ -0,0 +1,42 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+/* Memory owned by one document: a single block that tables are carved out
+ * of front to back and that is given back in one go. Large arenas are
+ * mapped straight from the system, on transparent huge pages where the
+ * kernel offers them, and only the pages actually touched take up memory;
+ * small ones come from the heap. Fresh memory always reads as zero. */
+typedef struct {
+    char *base;
+    size_t size;
+    size_t used;
+    int mapped;             /* base came from mmap rather than the heap */
+} Arena;
+
+/* Every allocation starts on a cache line of its own */
+#define ARENA_ALIGN 64
+
+/* Arenas at least this large are mapped rather than taken from the heap */
+#define ARENA_MAP_MIN ((size_t)1 << 20)
+
+/* Bytes an allocation of size takes up in an arena */
+static inline size_t arena_round(size_t size) {
+    return (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+/* An arena that holds nothing, safe to free */
+void arena_init(Arena *arena);
+
+/* Set aside size bytes, normally a sum of arena_round() sizes. Returns 0,
+ * or -1 with the arena left empty. */
+int arena_reserve(Arena *arena, size_t size);
+
+/* Zeroed memory for size bytes, or NULL once the arena is full */
+void *arena_alloc(Arena *arena, size_t size);
+
+/* Give back everything allocated from the arena */
+void arena_free(Arena *arena);
+
+#endif /* ARENA_H */
@@ -0,0 +1,291 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "format.h"
+#include "ndjson.h"
+#include "search.h"
+
+/* Output is gathered here and written in large blocks */
+#define BATCH_BUFFER_BYTES (1 << 20)
+/* Longest container summary, "[+] {N+ items} ..." */
+#define BATCH_SUMMARY_MAX 64
+
+typedef struct {
+    int fd;
+    char *buf;
+    size_t len;
+    int error;              /* errno of the write that failed, or 0 */
+} BatchWriter;
+
+static void writer_flush(BatchWriter *w) {
+    size_t done = 0;
+
+    while (done < w->len && !w->error) {
+        ssize_t n = write(w->fd, w->buf + done, w->len - done);
+        if (n < 0) {
+            if (errno != EINTR) w->error = errno;
+            continue;
+        }
+        done += n;
+    }
+    w->len = 0;
+}
+
+/* Room for n more bytes at the end of the buffer, or NULL if n is more
+ * than the buffer holds */
+static char *writer_room(BatchWriter *w, size_t n) {
+    if (w->len + n > BATCH_BUFFER_BYTES) writer_flush(w);
+    return n <= BATCH_BUFFER_BYTES ? w->buf + w->len : NULL;
+}
+
+static void writer_put(BatchWriter *w, const char *data, size_t len) {
+    char *room = writer_room(w, len);
+    if (room) {
+        memcpy(room, data, len);
+        w->len += len;
+        return;
+    }
+
+    // Too large to buffer, so written straight from the input
+    BatchWriter direct = { w->fd, (char *)data, len, 0 };
+    writer_flush(&direct);
+    if (direct.error) w->error = direct.error;
+}
+
+static void put_indent(BatchWriter *w, int width) {
+    char *room = writer_room(w, width);
+    memset(room, ' ', width);
+    w->len += width;
+}
+
+/* A token as the viewer shows it, but never cut short */
+static void put_value(BatchWriter *w, const char *json, const jsmntok_t *tok) {
+    size_t len = tok->end - tok->start + 2;
+    char *room = writer_room(w, len + 1);
+    if (room) {
+        w->len += format_token_value(json, tok, room, len + 1);
+        return;
+    }
+
+    int quote = tok->type == JSMN_STRING;
+    if (quote) writer_put(w, "\"", 1);
+    writer_put(w, json + tok->start, tok->end - tok->start);
+    if (quote) writer_put(w, "\"", 1);
+}
+
+static void put_summary(BatchWriter *w, const jsmntok_t *tok, int collapsed) {
+    char *room = writer_room(w, BATCH_SUMMARY_MAX);
+    format_summary(tok, collapsed, room, BATCH_SUMMARY_MAX);
+    w->len += strlen(room);
+}
+
+/* The JSON text of a value exactly as it appears in the input */
+static void put_json(BatchWriter *w, const JsonViewer *doc, int tok_idx) {
+    const jsmntok_t *tok = &doc->tokens[tok_idx];
+    jsmnint_t start = tok->start;
+    jsmnint_t end = tok->end;
+
+    // String tokens leave out their quotes
+    if (tok->type == JSMN_STRING) {
+        start--;
+        end++;
+    }
+    writer_put(w, doc->json_str + start, end - start);
+}
+
+/* The lines the viewer shows for the subtree at root with everything
+ * expanded, except that containers depth levels below root are collapsed */
+static void put_outline(BatchWriter *w, const JsonViewer *doc, int root, int depth) {
+    const JsonIndex *index = &doc->index;
+    int base = token_depth(index, root);
+    int end = skip_token(index, root);
+
+    for (int tok = root; tok < end && !w->error;) {
+        // Values drawn next to their key have no line of their own
+        if (tok != root && is_inline_value(index, tok)) {
+            tok++;
+            continue;
+        }
+
+        put_indent(w, (token_depth(index, tok) - base) * INDENT_SIZE);
+
+        int value = tok;
+        if (is_object_key(index, tok)) {
+            put_value(w, doc->json_str, &doc->tokens[tok]);
+            writer_put(w, " : ", 3);
+            value = tok + 1;
+        }
+        int collapsed = 0;
+        if (value < doc->token_count && is_container(index, value)) {
+            collapsed = depth >= 0 && token_depth(index, value) - base >= depth;
+            put_summary(w, &doc->tokens[value], collapsed);
+        } else if (value < doc->token_count) {
+            put_value(w, doc->json_str, &doc->tokens[value]);
+        }
+        writer_put(w, "\n", 1);
+
+        tok = collapsed && value == tok ? skip_token(index, tok) : tok + 1;
+    }
+}
+
+/* Where the values matched in one document go */
+typedef struct {
+    BatchWriter *w;
+    const BatchOptions *options;
+    const JsonViewer *doc;
+    int last;               /* last value written, or -1 */
+} ExtractSink;
+
+static void emit_extract(void *ctx, int tok_idx) {
+    ExtractSink *sink = ctx;
+
+    // A key that matches a text search stands for the value it names,
+    // which may well match too
+    if (is_object_key(&sink->doc->index, tok_idx)) tok_idx++;
+    if (tok_idx == sink->last || tok_idx >= sink->doc->token_count) return;
+    sink->last = tok_idx;
+
+    if (sink->options->outline) {
+        put_outline(sink->w, sink->doc, tok_idx, sink->options->depth);
+    } else {
+        put_json(sink->w, sink->doc, tok_idx);
+        writer_put(sink->w, "\n", 1);
+    }
+}
+
+/* Outline or extract from one parsed document, whose top-level values
+ * start in the path states root. key_match stands for a key outside the
+ * document that names its value and matches. */
+static void run_document(BatchWriter *w, const BatchOptions *options, const Query *query,
+                         const regex_t *re, const JsonViewer *doc, uint64_t root, int key_match) {
+    if (options->mode == BATCH_OUTLINE) {
+        // Only the first top-level value is laid out
+        if (doc->token_count > 0) put_outline(w, doc, 0, options->depth);
+        return;
+    }
+
+    ExtractSink sink = { w, options, doc, -1 };
+    if (key_match && doc->token_count > 0) emit_extract(&sink, 0);
+    search_each(query, re, doc, root, emit_extract, &sink);
+}
+
+/* The same, a record at a time. Records that do not parse are shown
+ * the way the viewer does, and cannot match. */
+static int run_records(BatchWriter *w, const BatchOptions *options, const Query *query,
+                       const regex_t *re, const JsonViewer *viewer) {
+    NdjsonScratch scratch;
+    int result = 0;
+
+    ndjson_scratch_init(&scratch);
+    for (int record = 0; record < viewer->ndjson->count && !w->error; record++) {
+        // A path that leads elsewhere spares parsing the record at all
+        uint64_t root = options->mode == BATCH_EXTRACT ? search_record_root(query, viewer, record)
+                                                       : QUERY_PATH_ROOT;
+        if (!root) continue;
+
+        int count = ndjson_scratch_parse(&scratch, viewer, record);
+        if (count == JSMN_ERROR_NOMEM) {
+            fprintf(stderr, "Out of memory\n");
+            result = -1;
+            break;
+        }
+        size_t key_len;
+        const char *key = options->mode == BATCH_OUTLINE ? ndjson_record_key(viewer, record, &key_len) : NULL;
+        if (count >= 0) {
+            if (key && scratch.doc.token_count > 0) {
+                writer_put(w, key, key_len);
+                writer_put(w, " : ", 3);
+            }
+            int key_match = options->mode == BATCH_EXTRACT &&
+                            search_record_key(query, re, viewer, record);
+            run_document(w, options, query, re, &scratch.doc, root, key_match);
+        } else if (options->mode == BATCH_OUTLINE) {
+            size_t len;
+            const char *text = ndjson_record_text(viewer, record, &len);
+            writer_put(w, "[!] ", 4);
+            if (key) {
+                writer_put(w, key, key_len);
+                writer_put(w, " : ", 3);
+            }
+            writer_put(w, text, len);
+            writer_put(w, "\n", 1);
+        }
+    }
+    ndjson_scratch_free(&scratch);
+    return result;
+}
+
+/* Counting takes the viewer's own search, on every core */
+static int run_count(BatchWriter *w, JsonViewer *viewer, const char *term) {
+    snprintf(viewer->search_term, sizeof(viewer->search_term), "%s", term);
+    if (search_start(viewer, NULL) < 0) {
+        fprintf(stderr, "%s\n", viewer->search_error ? viewer->search_error : "Out of memory");
+        return -1;
+    }
+    search_wait(viewer);
+
+    char line[32];
+    int len = snprintf(line, sizeof(line), "%d\n", viewer->search_match_count);
+    writer_put(w, line, len);
+    return 0;
+}
+
+int batch_run(JsonViewer *viewer, const BatchOptions *options, int fd) {
+    int result = viewer_wait(viewer);
+    if (result == JSON_ERROR_READ) {
+        fprintf(stderr, "Failed to read input: %s\n", strerror(viewer->read_errno));
+        return -1;
+    }
+    if (result == JSON_ERROR_TOO_LARGE) {
+        fprintf(stderr, "Input is larger than 2 GiB and needs the wide-offset build "
+                        "(make wide, then run jsonViewer_wide)\n");
+        return -1;
+    }
+    if (result < 0) {
+        fprintf(stderr, "Failed to parse JSON: %d\n", result);
+        return -1;
+    }
+
+    BatchWriter w = { fd, malloc(BATCH_BUFFER_BYTES), 0, 0 };
+    if (!w.buf) {
+        fprintf(stderr, "Out of memory\n");
+        return -1;
+    }
+
+    Query query;
+    regex_t re;
+    int has_re = 0;
+    const char *error = NULL;
+    if (options->mode == BATCH_COUNT) {
+        result = run_count(&w, viewer, options->term);
+    } else if (options->mode == BATCH_EXTRACT &&
+               query_compile(&query, options->term, &error) < 0) {
+        fprintf(stderr, "%s\n", error);
+        result = -1;
+    } else if (options->mode == BATCH_EXTRACT && query.kind == QUERY_REGEX &&
+               query_regcomp(&query, &re) < 0) {
+        fprintf(stderr, "Invalid regular expression\n");
+        result = -1;
+    } else {
+        has_re = options->mode == BATCH_EXTRACT && query.kind == QUERY_REGEX;
+        if (viewer->ndjson) {
+            result = run_records(&w, options, &query, &re, viewer);
+        } else {
+            run_document(&w, options, &query, &re, viewer, QUERY_PATH_ROOT, 0);
+        }
+    }
+
+    writer_flush(&w);
+    if (w.error) {
+        fprintf(stderr, "Cannot write output: %s\n", strerror(w.error));
+        result = -1;
+    }
+
+    if (has_re) regfree(&re);
+    free(w.buf);
+    return result;
+}
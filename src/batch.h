@@ -0,0 +1,27 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "viewer.h"
+
+/* Headless use of a document opened as for viewing, for scripts: what is
+ * written goes through one large buffer straight to a file descriptor */
+typedef enum {
+    BATCH_OUTLINE,          /* the lines the viewer shows, fully expanded */
+    BATCH_EXTRACT,          /* the JSON text of every value a query matches */
+    BATCH_COUNT             /* the number of tokens a query matches */
+} BatchMode;
+
+typedef struct {
+    BatchMode mode;
+    const char *term;       /* search term of BATCH_EXTRACT and BATCH_COUNT */
+    int outline;            /* BATCH_EXTRACT: outline each value instead */
+    int depth;              /* containers this many levels below the top of
+                               an outline are collapsed; -1 for no limit */
+} BatchOptions;
+
+/* Wait for the document to finish loading, then run the job and write the
+ * result to fd. A JSON Lines document is handled a record at a time.
+ * Returns 0, or -1 with the reason printed to stderr. */
+int batch_run(JsonViewer *viewer, const BatchOptions *options, int fd);
+
+#endif /* BATCH_H */
@@ -0,0 +1,74 @@
+#ifndef BITSET_H
+#define BITSET_H
+
+#include <stdint.h>
+
+/* Flat array of bits, one per token, packed into 64-bit words */
+#define BITSET_WORDS(n) (((size_t)(n) + 63) / 64)
+
+/* Words are read with relaxed atomic loads, which compile to plain loads,
+ * so a bitset may be scanned while another thread stores whole words */
+#define BITSET_WORD(bits, w) __atomic_load_n(&(bits)[w], __ATOMIC_RELAXED)
+
+static inline int bitset_test(const uint64_t *bits, int i) {
+    return (BITSET_WORD(bits, i >> 6) >> (i & 63)) & 1;
+}
+
+static inline void bitset_set(uint64_t *bits, int i) {
+    bits[i >> 6] |= (uint64_t)1 << (i & 63);
+}
+
+static inline void bitset_clear(uint64_t *bits, int i) {
+    bits[i >> 6] &= ~((uint64_t)1 << (i & 63));
+}
+
+/* Number of set bits in [0, end) */
+static inline int bitset_count(const uint64_t *bits, int end) {
+    int total = 0;
+    int w;
+
+    if (end <= 0) return 0;
+
+    for (w = 0; w < end >> 6; w++) {
+        total += __builtin_popcountll(BITSET_WORD(bits, w));
+    }
+    if (end & 63) {
+        total += __builtin_popcountll(BITSET_WORD(bits, w) & ~(~(uint64_t)0 << (end & 63)));
+    }
+    return total;
+}
+
+/* First set bit in [from, count), or -1 */
+static inline int bitset_next(const uint64_t *bits, int from, int count) {
+    if (from < 0) from = 0;
+    if (from >= count) return -1;
+
+    int w = from >> 6;
+    int last = (count - 1) >> 6;
+    uint64_t word = BITSET_WORD(bits, w) & (~(uint64_t)0 << (from & 63));
+
+    while (!word) {
+        if (++w > last) return -1;
+        word = BITSET_WORD(bits, w);
+    }
+
+    int i = (w << 6) + __builtin_ctzll(word);
+    return i < count ? i : -1;
+}
+
+/* Last set bit in [0, from], or -1 */
+static inline int bitset_prev(const uint64_t *bits, int from) {
+    if (from < 0) return -1;
+
+    int w = from >> 6;
+    uint64_t word = BITSET_WORD(bits, w) & (~(uint64_t)0 >> (63 - (from & 63)));
+
+    while (!word) {
+        if (--w < 0) return -1;
+        word = BITSET_WORD(bits, w);
+    }
+
+    return (w << 6) + 63 - __builtin_clzll(word);
+}
+
+#endif /* BITSET_H */
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "bitset.h"
+#include "format.h"
+#include "ndjson.h"
+
+/* Copy the token text rather than go through printf, since batch mode
+ * formats every token of the document */
+int format_token_value(const char *json, const jsmntok_t *tok, char *buf, int bufsize) {
+    int quote = tok->type == JSMN_STRING;
+    jsmnint_t len = tok->end - tok->start;
+    char *out = buf;
+    int room = bufsize - 1;
+
+    if (bufsize <= 0) return 0;
+
+    if (quote && room > 0) {
+        *out++ = '"';
+        room--;
+    }
+    if (len > room) len = room;
+    memcpy(out, json + tok->start, len);
+    out += len;
+    room -= len;
+    if (quote && room > 0) {
+        *out++ = '"';
+    }
+    *out = '\0';
+    return out - buf;
+}
+
+void format_summary(const jsmntok_t *tok, int collapsed, char *buf, int bufsize) {
+    // A container still being parsed has no end yet and may gain items;
+    // counts past JSMN_SIZE_MAX are not kept
+    const char *more = tok->end < 0 || tok->size == JSMN_SIZE_MAX ? "+" : "";
+
+    if (tok->type == JSMN_OBJECT) {
+        snprintf(buf, bufsize, "%s{%d%s items}%s", collapsed ? "[+] " : "[-] ", tok->size, more, collapsed ? " ..." : "");
+    } else {
+        snprintf(buf, bufsize, "%s[%d%s items]%s", collapsed ? "[+] " : "[-] ", tok->size, more, collapsed ? " ..." : "");
+    }
+}
+
+void format_container(const JsonViewer *viewer, int tok_idx, char *buf, int bufsize) {
+    format_summary(&viewer->tokens[tok_idx], bitset_test(viewer->collapsed, tok_idx), buf, bufsize);
+}
+
+void format_record(const JsonViewer *viewer, int record, char *buf, int bufsize) {
+    size_t len;
+    const char *text = ndjson_record_text(viewer, record, &len);
+    int failed;
+    const char *marker = "";
+
+    ndjson_parsed(viewer, record, &failed);
+    if (failed) {
+        marker = "[!] ";
+    } else if (len > 0 && (text[0] == '{' || text[0] == '[')) {
+        marker = "[+] ";
+    }
+
+    int n = snprintf(buf, bufsize, "%s", marker);
+    if (n >= bufsize) return;
+    n += format_record_key(viewer, record, buf + n, bufsize - n);
+
+    int room = bufsize - 1 - n;
+    if (room < 0) room = 0;
+    if (len > (size_t)room) len = room;
+    snprintf(buf + n, bufsize - n, "%.*s", (int)len, text);
+}
+
+int format_record_key(const JsonViewer *viewer, int record, char *buf, int bufsize) {
+    size_t len;
+    const char *key = ndjson_record_key(viewer, record, &len);
+
+    if (!key || bufsize <= 0) return 0;
+    int room = bufsize - 1;
+    if (len > (size_t)room) len = room;
+    int n = snprintf(buf, bufsize, "%.*s : ", (int)len, key);
+    return n < bufsize ? n : bufsize - 1;
+}
+
+void format_record_line(const JsonViewer *viewer, int record, const JsonViewer *doc, int tok_idx,
+                        char *buf, int bufsize) {
+    int n = tok_idx == 0 ? format_record_key(viewer, record, buf, bufsize) : 0;
+    format_line(doc, tok_idx, buf + n, bufsize - n);
+}
+
+void format_line(const JsonViewer *doc, int tok_idx, char *buf, int bufsize) {
+    const jsmntok_t *tok = &doc->tokens[tok_idx];
+    char value_buf[256];
+
+    if (!is_object_key(&doc->index, tok_idx)) {
+        if (is_container(&doc->index, tok_idx)) {
+            format_container(doc, tok_idx, buf, bufsize);
+        } else {
+            format_token_value(doc->json_str, tok, buf, bufsize);
+        }
+        return;
+    }
+
+    format_token_value(doc->json_str, tok, value_buf, sizeof(value_buf));
+    int n = snprintf(buf, bufsize, "%s : ", value_buf);
+    if (n >= bufsize) return;
+
+    // The value is the token right after its key
+    int value_tok_idx = skip_token(&doc->index, tok_idx);
+    if (value_tok_idx >= doc->token_count) return;
+
+    if (is_container(&doc->index, value_tok_idx)) {
+        format_container(doc, value_tok_idx, buf + n, bufsize - n);
+    } else {
+        format_token_value(doc->json_str, &doc->tokens[value_tok_idx], buf + n, bufsize - n);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include "viewer.h"
+
+/* Spaces per level of nesting */
+#define INDENT_SIZE 4
+
+/* The text of the lines the viewer shows, shared by the terminal front
+ * end and batch mode. Every function writes at most bufsize bytes,
+ * NUL-terminated, and cuts off what does not fit. */
+
+/* A string token in quotes, any other token as it appears in the input.
+ * Returns the length written. */
+int format_token_value(const char *json, const jsmntok_t *tok, char *buf, int bufsize);
+
+/* The "[-] {N items}" summary of an object or array, or "[+] ... ..."
+ * when collapsed */
+void format_summary(const jsmntok_t *tok, int collapsed, char *buf, int bufsize);
+
+/* format_summary, collapsed as in viewer->collapsed */
+void format_container(const JsonViewer *viewer, int tok_idx, char *buf, int bufsize);
+
+/* A JSON Lines record that is not expanded, as its raw text */
+void format_record(const JsonViewer *viewer, int record, char *buf, int bufsize);
+
+/* The "key : " in front of a record that is an object's member in
+ * skeleton mode, or nothing. Returns the length written. */
+int format_record_key(const JsonViewer *viewer, int record, char *buf, int bufsize);
+
+/* The line of a token: a key with the value drawn next to it, a container
+ * summary, or an array element */
+void format_line(const JsonViewer *doc, int tok_idx, char *buf, int bufsize);
+
+/* format_line for a token of a record's document, with the record's key
+ * in front of its first line */
+void format_record_line(const JsonViewer *viewer, int record, const JsonViewer *doc, int tok_idx,
+                        char *buf, int bufsize);
+
+#endif /* FORMAT_H */
@@ -36,6 +36,21 @@ extern "C" {
 #define JSMN_API extern
 #endif
 
+/**
+ * Byte offsets into the JSON string. The default layout keeps them 32-bit,
+ * which caps input at 2 GiB but keeps tokens small; define JSMN_WIDE_OFFSETS
+ * to parse larger inputs. Token counts and indices stay 32-bit either way.
+ */
+#ifdef JSMN_WIDE_OFFSETS
+typedef long long jsmnint_t;
+typedef unsigned long long jsmnuint_t;
+#define JSMN_OFFSET_MAX 0x7fffffffffffffffLL
+#else
+typedef int jsmnint_t;
+typedef unsigned int jsmnuint_t;
+#define JSMN_OFFSET_MAX 0x7fffffff
+#endif
+
 /**
  * JSON type identifier. Basic types are:
  * 	o Object
@@ -60,30 +75,67 @@ enum jsmnerr {
   JSMN_ERROR_PART = -3
 };
 
+/**
+ * Largest child count a token can hold; counts saturate there.
+ */
+#define JSMN_SIZE_MAX ((1u << 28) - 1)
+
 /**
  * JSON token description.
- * type		type (object, array, string etc.)
  * start	start position in JSON data string
  * end		end position in JSON data string
+ * type		type (object, array, string etc.)
+ * size		number of children, packed with the type into one word
+ * With JSMN_PARENT_LINKS the parent links live in a separate array, see
+ * jsmn_parser.parents.
  */
 typedef struct jsmntok {
-  jsmntype_t type;
-  int start;
-  int end;
-  int size;
+  jsmnint_t start;
+  jsmnint_t end;
+  unsigned int type : 4;
+  unsigned int size : 28;
+} jsmntok_t;
+
 #ifdef JSMN_PARENT_LINKS
-  int parent;
+/**
+ * Segment parsing, for tokenizing one document on several threads. A
+ * segment starts right after a ',' that separates members of a container
+ * opened before it, and may add members to that container and close it
+ * and others further out. Those outer containers are numbered outwards
+ * from the innermost, 0; a token directly under outer container k gets
+ * the parent link JSMN_OUTER(k), and what the segment did to it is
+ * recorded in an outer entry. The caller stitches segments together.
+ */
+#define JSMN_OUTER(k) (-2 - (int)(k))
+
+typedef struct jsmn_outer {
+  unsigned int size; /* children the segment added */
+  jsmnint_t end;     /* offset past its closing bracket, if closed */
+  int type;          /* JSMN_OBJECT or JSMN_ARRAY, going by that bracket */
+} jsmn_outer;
 #endif
-} jsmntok_t;
 
 /**
  * JSON parser. Contains an array of token blocks available. Also stores
  * the string being parsed now and current position in that string.
  */
 typedef struct jsmn_parser {
-  unsigned int pos;     /* offset in the JSON string */
+  jsmnuint_t pos;       /* offset in the JSON string */
   unsigned int toknext; /* next token to allocate */
   int toksuper;         /* superior token node, e.g. parent object or array */
+#ifdef JSMN_PARENT_LINKS
+  /* Parent link of each token, as many as there are tokens. Set by the
+   * caller before every jsmn_parse, since it may move between calls. A
+   * link may be rewritten to any enclosing token between calls as long as
+   * no open container is skipped. */
+  int *parents;
+  /* Segment mode only, see jsmn_init_segment: one entry per outer
+   * container reached so far. Set by the caller before every jsmn_parse,
+   * like parents, with outer[0].size zeroed before the first. */
+  jsmn_outer *outer;
+  unsigned int outer_capacity;
+  unsigned int outer_closed; /* outer containers closed so far */
+#endif
 } jsmn_parser;
 
 /**
@@ -91,6 +143,18 @@ typedef struct jsmn_parser {
  */
 JSMN_API void jsmn_init(jsmn_parser *parser);
 
+#ifdef JSMN_PARENT_LINKS
+/**
+ * Create a parser for the segment of a document starting at pos, right
+ * after a ',' outside any string. Token indices and links start from 0
+ * within the segment; offsets stay relative to the whole document. Runs
+ * out of memory once the segment closes more than outer_capacity - 1
+ * outer containers, and does not report unclosed containers as
+ * JSMN_ERROR_PART.
+ */
+JSMN_API void jsmn_init_segment(jsmn_parser *parser, size_t pos);
+#endif
+
 /**
  * Run JSON parser. It parses a JSON data string into and array of tokens, each
  * describing
@@ -100,6 +164,221 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
                         jsmntok_t *tokens, const unsigned int num_tokens);
 
 #ifndef JSMN_HEADER
+#include <pthread.h>
+
+/**
+ * Byte scanners. The tokenizer spends most of its time walking through
+ * string bodies, indentation and number literals one byte at a time; these
+ * helpers jump straight to the next byte it has to look at. On x86 they
+ * compare 16 or 32 bytes at once, turn the comparisons into a bitmask and
+ * take its lowest set bit. The widest kernel the CPU supports is picked at
+ * runtime; define JSMN_NO_SIMD to always use the scalar loops.
+ */
+#if !defined(JSMN_NO_SIMD) && defined(__SSE2__) &&                            \
+    (defined(__x86_64__) || defined(__i386__))
+#define JSMN_SIMD_X86
+#include <immintrin.h>
+#endif
+
+typedef size_t (*jsmn_scan_fn)(const char *js, size_t pos, size_t len);
+
+/* First byte at or after pos that ends a run of string characters: a quote,
+ * a backslash or a NUL. Returns len if there is none. */
+static size_t jsmn_scan_string_scalar(const char *js, size_t pos, size_t len) {
+  for (; pos < len; pos++) {
+    if (js[pos] == '\"' || js[pos] == '\\' || js[pos] == '\0') {
+      break;
+    }
+  }
+  return pos;
+}
+
+/* First byte at or after pos that is not JSON whitespace */
+static size_t jsmn_scan_space_scalar(const char *js, size_t pos, size_t len) {
+  for (; pos < len; pos++) {
+    if (js[pos] != ' ' && js[pos] != '\t' && js[pos] != '\n' &&
+        js[pos] != '\r') {
+      break;
+    }
+  }
+  return pos;
+}
+
+/* First byte at or after pos that can end a primitive or make it invalid:
+ * whitespace, a delimiter, a control character or a non-ASCII byte */
+static int jsmn_primitive_stop(const char c) {
+  switch (c) {
+#ifndef JSMN_STRICT
+  case ':':
+#endif
+  case ',':
+  case ']':
+  case '}':
+    return 1;
+  default:
+    return (unsigned char)c <= ' ' || (unsigned char)c >= 127;
+  }
+}
+
+static size_t jsmn_scan_primitive_scalar(const char *js, size_t pos,
+                                         size_t len) {
+  for (; pos < len; pos++) {
+    if (jsmn_primitive_stop(js[pos])) {
+      break;
+    }
+  }
+  return pos;
+}
+
+#ifdef JSMN_SIMD_X86
+static size_t jsmn_scan_string_sse2(const char *js, size_t pos, size_t len) {
+  const __m128i quote = _mm_set1_epi8('\"');
+  const __m128i backslash = _mm_set1_epi8('\\');
+  const __m128i zero = _mm_setzero_si128();
+  for (; pos + 16 <= len; pos += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(js + pos));
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+        _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote),
+                                  _mm_cmpeq_epi8(v, backslash)),
+                     _mm_cmpeq_epi8(v, zero)));
+    if (mask) {
+      return pos + __builtin_ctz(mask);
+    }
+  }
+  return jsmn_scan_string_scalar(js, pos, len);
+}
+
+static size_t jsmn_scan_space_sse2(const char *js, size_t pos, size_t len) {
+  const __m128i space = _mm_set1_epi8(' ');
+  const __m128i tab = _mm_set1_epi8('\t');
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i cr = _mm_set1_epi8('\r');
+  for (; pos + 16 <= len; pos += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(js + pos));
+    __m128i ws = _mm_or_si128(
+        _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, tab)),
+        _mm_or_si128(_mm_cmpeq_epi8(v, newline), _mm_cmpeq_epi8(v, cr)));
+    unsigned mask = ~(unsigned)_mm_movemask_epi8(ws) & 0xffffu;
+    if (mask) {
+      return pos + __builtin_ctz(mask);
+    }
+  }
+  return jsmn_scan_space_scalar(js, pos, len);
+}
+
+static size_t jsmn_scan_primitive_sse2(const char *js, size_t pos,
+                                       size_t len) {
+  /* Signed compare: bytes >= 128 are negative and fall below ' ' + 1 */
+  const __m128i low = _mm_set1_epi8(' ' + 1);
+  const __m128i del = _mm_set1_epi8(127);
+  const __m128i comma = _mm_set1_epi8(',');
+  const __m128i bracket = _mm_set1_epi8(']');
+  const __m128i brace = _mm_set1_epi8('}');
+#ifndef JSMN_STRICT
+  const __m128i colon = _mm_set1_epi8(':');
+#endif
+  for (; pos + 16 <= len; pos += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(js + pos));
+    __m128i stop = _mm_or_si128(
+        _mm_or_si128(_mm_cmplt_epi8(v, low), _mm_cmpeq_epi8(v, del)),
+        _mm_or_si128(_mm_cmpeq_epi8(v, comma),
+                     _mm_or_si128(_mm_cmpeq_epi8(v, bracket),
+                                  _mm_cmpeq_epi8(v, brace))));
+#ifndef JSMN_STRICT
+    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(v, colon));
+#endif
+    unsigned mask = (unsigned)_mm_movemask_epi8(stop);
+    if (mask) {
+      return pos + __builtin_ctz(mask);
+    }
+  }
+  return jsmn_scan_primitive_scalar(js, pos, len);
+}
+
+__attribute__((target("avx2"))) static size_t
+jsmn_scan_string_avx2(const char *js, size_t pos, size_t len) {
+  const __m256i quote = _mm256_set1_epi8('\"');
+  const __m256i backslash = _mm256_set1_epi8('\\');
+  const __m256i zero = _mm256_setzero_si256();
+  for (; pos + 32 <= len; pos += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(js + pos));
+    unsigned mask = (unsigned)_mm256_movemask_epi8(
+        _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, quote),
+                                        _mm256_cmpeq_epi8(v, backslash)),
+                        _mm256_cmpeq_epi8(v, zero)));
+    if (mask) {
+      return pos + __builtin_ctz(mask);
+    }
+  }
+  return jsmn_scan_string_sse2(js, pos, len);
+}
+
+__attribute__((target("avx2"))) static size_t
+jsmn_scan_space_avx2(const char *js, size_t pos, size_t len) {
+  const __m256i space = _mm256_set1_epi8(' ');
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i newline = _mm256_set1_epi8('\n');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  for (; pos + 32 <= len; pos += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(js + pos));
+    __m256i ws = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, space),
+                        _mm256_cmpeq_epi8(v, tab)),
+        _mm256_or_si256(_mm256_cmpeq_epi8(v, newline),
+                        _mm256_cmpeq_epi8(v, cr)));
+    unsigned mask = ~(unsigned)_mm256_movemask_epi8(ws);
+    if (mask) {
+      return pos + __builtin_ctz(mask);
+    }
+  }
+  return jsmn_scan_space_sse2(js, pos, len);
+}
+#endif /* JSMN_SIMD_X86 */
+
+typedef struct {
+  jsmn_scan_fn string;
+  jsmn_scan_fn space;
+  jsmn_scan_fn primitive;
+} jsmn_scanner_set;
+
+/**
+ * The scanners in use, one set for the whole program. Unless JSMN_STATIC
+ * is defined, a second translation unit compiling the implementation fails
+ * to link instead of keeping a set of its own. Parsers are set up on many
+ * threads at once, so the set is picked exactly once.
+ */
+#ifdef JSMN_STATIC
+static
+#endif
+jsmn_scanner_set jsmn_scanners;
+static pthread_once_t jsmn_scanners_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Picks the widest scanners the running CPU supports.
+ */
+static void jsmn_pick_scanners(void) {
+#ifdef JSMN_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    jsmn_scanners.space = jsmn_scan_space_avx2;
+    jsmn_scanners.primitive = jsmn_scan_primitive_sse2;
+    jsmn_scanners.string = jsmn_scan_string_avx2;
+  } else {
+    jsmn_scanners.space = jsmn_scan_space_sse2;
+    jsmn_scanners.primitive = jsmn_scan_primitive_sse2;
+    jsmn_scanners.string = jsmn_scan_string_sse2;
+  }
+#else
+  jsmn_scanners.space = jsmn_scan_space_scalar;
+  jsmn_scanners.primitive = jsmn_scan_primitive_scalar;
+  jsmn_scanners.string = jsmn_scan_string_scalar;
+#endif
+}
+
+static void jsmn_select_scanners(void) {
+  pthread_once(&jsmn_scanners_once, jsmn_pick_scanners);
+}
+
 /**
  * Allocates a fresh unused token from the token pool.
  */
@@ -109,20 +388,46 @@ static jsmntok_t *jsmn_alloc_token(jsmn_parser *parser, jsmntok_t *tokens,
   if (parser->toknext >= num_tokens) {
     return NULL;
   }
+#ifdef JSMN_PARENT_LINKS
+  parser->parents[parser->toknext] = -1;
+#endif
   tok = &tokens[parser->toknext++];
   tok->start = tok->end = -1;
   tok->size = 0;
+  return tok;
+}
+
+/**
+ * Counts one more child of a token.
+ */
+static void jsmn_add_child(jsmntok_t *token) {
+  if (token->size < JSMN_SIZE_MAX) {
+    token->size++;
+  }
+}
+
+/**
+ * Counts one more child of the superior token, which in segment mode may
+ * be an outer container.
+ */
+static void jsmn_add_super_child(jsmn_parser *parser, jsmntok_t *tokens) {
 #ifdef JSMN_PARENT_LINKS
-  tok->parent = -1;
+  if (parser->toksuper < -1) {
+    jsmn_outer *outer = &parser->outer[JSMN_OUTER(0) - parser->toksuper];
+    if (outer->size < JSMN_SIZE_MAX) {
+      outer->size++;
+    }
+    return;
+  }
 #endif
-  return tok;
+  jsmn_add_child(&tokens[parser->toksuper]);
 }
 
 /**
  * Fills token type and boundaries.
  */
 static void jsmn_fill_token(jsmntok_t *token, const jsmntype_t type,
-                            const int start, const int end) {
+                            const jsmnint_t start, const jsmnint_t end) {
   token->type = type;
   token->start = start;
   token->end = end;
@@ -136,11 +441,13 @@ static int jsmn_parse_primitive(jsmn_parser *parser, const char *js,
                                 const size_t len, jsmntok_t *tokens,
                                 const size_t num_tokens) {
   jsmntok_t *token;
-  int start;
+  jsmnint_t start;
 
   start = parser->pos;
 
-  for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
+  /* Jump to the first byte that ends the primitive or is not allowed in it */
+  parser->pos = jsmn_scanners.primitive(js, parser->pos, len);
+  if (parser->pos < len && js[parser->pos] != '\0') {
     switch (js[parser->pos]) {
 #ifndef JSMN_STRICT
     /* In strict mode primitive must be followed by "," or "}" or "]" */
@@ -155,10 +462,6 @@ static int jsmn_parse_primitive(jsmn_parser *parser, const char *js,
     case '}':
       goto found;
     default:
-                   /* to quiet a warning from gcc*/
-      break;
-    }
-    if (js[parser->pos] < 32 || js[parser->pos] >= 127) {
       parser->pos = start;
       return JSMN_ERROR_INVAL;
     }
@@ -181,7 +484,7 @@ found:
   }
   jsmn_fill_token(token, JSMN_PRIMITIVE, start, parser->pos);
 #ifdef JSMN_PARENT_LINKS
-  token->parent = parser->toksuper;
+  parser->parents[token - tokens] = parser->toksuper;
 #endif
   parser->pos--;
   return 0;
@@ -195,13 +498,20 @@ static int jsmn_parse_string(jsmn_parser *parser, const char *js,
                              const size_t num_tokens) {
   jsmntok_t *token;
 
-  int start = parser->pos;
+  jsmnint_t start = parser->pos;
   
   /* Skip starting quote */
   parser->pos++;
   
-  for (; parser->pos < len && js[parser->pos] != '\0'; parser->pos++) {
-    char c = js[parser->pos];
+  for (; parser->pos < len; parser->pos++) {
+    char c;
+
+    /* Skip ordinary characters in bulk */
+    parser->pos = jsmn_scanners.string(js, parser->pos, len);
+    if (parser->pos >= len || js[parser->pos] == '\0') {
+      break;
+    }
+    c = js[parser->pos];
 
     /* Quote: end of string */
     if (c == '\"') {
@@ -215,7 +525,7 @@ static int jsmn_parse_string(jsmn_parser *parser, const char *js,
       }
       jsmn_fill_token(token, JSMN_STRING, start + 1, parser->pos);
 #ifdef JSMN_PARENT_LINKS
-      token->parent = parser->toksuper;
+      parser->parents[token - tokens] = parser->toksuper;
 #endif
       return 0;
     }
@@ -289,16 +599,16 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
         return JSMN_ERROR_NOMEM;
       }
       if (parser->toksuper != -1) {
-        jsmntok_t *t = &tokens[parser->toksuper];
 #ifdef JSMN_STRICT
         /* In strict mode an object or array can't become a key */
-        if (t->type == JSMN_OBJECT) {
+        if (parser->toksuper >= 0 &&
+            tokens[parser->toksuper].type == JSMN_OBJECT) {
           return JSMN_ERROR_INVAL;
         }
 #endif
-        t->size++;
+        jsmn_add_super_child(parser, tokens);
 #ifdef JSMN_PARENT_LINKS
-        token->parent = parser->toksuper;
+        parser->parents[token - tokens] = parser->toksuper;
 #endif
       }
       token->type = (c == '{' ? JSMN_OBJECT : JSMN_ARRAY);
@@ -312,26 +622,41 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
       }
       type = (c == '}' ? JSMN_OBJECT : JSMN_ARRAY);
 #ifdef JSMN_PARENT_LINKS
-      if (parser->toknext < 1) {
+      /* The innermost open container is the superior token or encloses
+       * it. Starting from the last token instead would first climb
+       * through every container closed below it, which costs quadratic
+       * time on deeply nested input. */
+      if (parser->toksuper == -1) {
         return JSMN_ERROR_INVAL;
       }
-      token = &tokens[parser->toknext - 1];
+      i = parser->toksuper;
       for (;;) {
+        if (i < -1) {
+          /* Segment mode: an outer container closes */
+          unsigned int k = JSMN_OUTER(0) - i;
+          if (k + 1 >= parser->outer_capacity) {
+            return JSMN_ERROR_NOMEM;
+          }
+          parser->outer[k].end = parser->pos + 1;
+          parser->outer[k].type = type;
+          parser->outer[k + 1].size = 0;
+          parser->outer_closed = k + 1;
+          parser->toksuper = JSMN_OUTER(k + 1);
+          break;
+        }
+        token = &tokens[i];
         if (token->start != -1 && token->end == -1) {
           if (token->type != type) {
             return JSMN_ERROR_INVAL;
           }
           token->end = parser->pos + 1;
-          parser->toksuper = token->parent;
+          parser->toksuper = parser->parents[i];
           break;
         }
-        if (token->parent == -1) {
-          if (token->type != type || parser->toksuper == -1) {
-            return JSMN_ERROR_INVAL;
-          }
-          break;
+        if (parser->parents[i] == -1) {
+          return JSMN_ERROR_INVAL;
         }
-        token = &tokens[token->parent];
+        i = parser->parents[i];
       }
 #else
       for (i = parser->toknext - 1; i >= 0; i--) {
@@ -365,23 +690,25 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
       }
       count++;
       if (parser->toksuper != -1 && tokens != NULL) {
-        tokens[parser->toksuper].size++;
+        jsmn_add_super_child(parser, tokens);
       }
       break;
     case '\t':
     case '\r':
     case '\n':
     case ' ':
+      /* Land on the last blank so the loop increment steps past the run */
+      parser->pos = jsmn_scanners.space(js, parser->pos, len) - 1;
       break;
     case ':':
       parser->toksuper = parser->toknext - 1;
       break;
     case ',':
-      if (tokens != NULL && parser->toksuper != -1 &&
+      if (tokens != NULL && parser->toksuper >= 0 &&
           tokens[parser->toksuper].type != JSMN_ARRAY &&
           tokens[parser->toksuper].type != JSMN_OBJECT) {
 #ifdef JSMN_PARENT_LINKS
-        parser->toksuper = tokens[parser->toksuper].parent;
+        parser->toksuper = parser->parents[parser->toksuper];
 #else
         for (i = parser->toknext - 1; i >= 0; i--) {
           if (tokens[i].type == JSMN_ARRAY || tokens[i].type == JSMN_OBJECT) {
@@ -411,7 +738,7 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
     case 'f':
     case 'n':
       /* And they must not be keys of the object */
-      if (tokens != NULL && parser->toksuper != -1) {
+      if (tokens != NULL && parser->toksuper >= 0) {
         const jsmntok_t *t = &tokens[parser->toksuper];
         if (t->type == JSMN_OBJECT ||
             (t->type == JSMN_STRING && t->size != 0)) {
@@ -428,7 +755,7 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
       }
       count++;
       if (parser->toksuper != -1 && tokens != NULL) {
-        tokens[parser->toksuper].size++;
+        jsmn_add_super_child(parser, tokens);
       }
       break;
 
@@ -441,12 +768,24 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
   }
 
   if (tokens != NULL) {
+#ifdef JSMN_PARENT_LINKS
+    /* Every open container encloses the current superior token, so only
+     * that chain needs checking. Keeps resumed parses from rescanning the
+     * whole token array on each call. Segments are expected to end with
+     * containers open. */
+    for (i = parser->outer ? -1 : parser->toksuper; i >= 0; i = parser->parents[i]) {
+      if (tokens[i].start != -1 && tokens[i].end == -1) {
+        return JSMN_ERROR_PART;
+      }
+    }
+#else
     for (i = parser->toknext - 1; i >= 0; i--) {
       /* Unmatched opened object or array */
       if (tokens[i].start != -1 && tokens[i].end == -1) {
         return JSMN_ERROR_PART;
       }
     }
+#endif
   }
 
   return count;
@@ -457,11 +796,26 @@ JSMN_API int jsmn_parse(jsmn_parser *parser, const char *js, const size_t len,
  * available.
  */
 JSMN_API void jsmn_init(jsmn_parser *parser) {
+  jsmn_select_scanners();
   parser->pos = 0;
   parser->toknext = 0;
   parser->toksuper = -1;
+#ifdef JSMN_PARENT_LINKS
+  parser->parents = NULL;
+  parser->outer = NULL;
+  parser->outer_capacity = 0;
+  parser->outer_closed = 0;
+#endif
 }
 
+#ifdef JSMN_PARENT_LINKS
+JSMN_API void jsmn_init_segment(jsmn_parser *parser, size_t pos) {
+  jsmn_init(parser);
+  parser->pos = pos;
+  parser->toksuper = JSMN_OUTER(0);
+}
+#endif
+
 #endif /* JSMN_HEADER */
 
 #ifdef __cplusplus
@@ -0,0 +1,285 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <zlib.h>
+#ifdef JSON_DECOMPRESS_ZSTD
+#include <zstd.h>
+#endif
+
+#include "json_decompress.h"
+#include "json_source.h"
+
+/* Decompressed output is handed over in slots, so the pump thread can run
+ * this far ahead of the reader */
+#define DECOMPRESS_SLOTS 4
+#define DECOMPRESS_SLOT_BYTES (1 << 20)
+#define DECOMPRESS_INPUT_BYTES (256 << 10)
+/* How long the reader waits before checking for cancellation */
+#define DECOMPRESS_WAIT_MS 100
+
+struct JsonDecompressor {
+    JsonCompression format;
+    int fd;
+    z_stream z;
+#ifdef JSON_DECOMPRESS_ZSTD
+    ZSTD_DStream *zstd;
+#endif
+
+    /* Compressed input; only the pump thread touches it */
+    unsigned char in[DECOMPRESS_INPUT_BYTES];
+    size_t in_len, in_pos;
+    int input_done;     /* fd is at its end */
+    int frame_done;     /* the last member or frame was complete */
+    int flushing;       /* the decoder may hold output it had no room for */
+
+    /* Slots [head, head + count) hold output; head_pos bytes of the first
+     * were already read */
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    char *slots[DECOMPRESS_SLOTS];
+    size_t slot_len[DECOMPRESS_SLOTS];
+    int head, count;
+    size_t head_pos;
+    int finished;       /* the pump thread has produced its last slot */
+    int error;          /* errno that stopped it, or 0 */
+    int stop;
+};
+
+JsonCompression json_compression_detect(const void *magic, size_t len) {
+    const unsigned char *m = magic;
+
+    if (len >= 2 && m[0] == 0x1f && m[1] == 0x8b) return JSON_COMPRESSION_GZIP;
+    if (len >= 4 && m[0] == 0x28 && m[1] == 0xb5 && m[2] == 0x2f && m[3] == 0xfd) {
+        return JSON_COMPRESSION_ZSTD;
+    }
+    return JSON_COMPRESSION_NONE;
+}
+
+int json_compression_supported(JsonCompression format) {
+#ifndef JSON_DECOMPRESS_ZSTD
+    if (format == JSON_COMPRESSION_ZSTD) return 0;
+#endif
+    return 1;
+}
+
+/* Decompress from the pending input into out. Returns the bytes produced,
+ * or -1 if the data is corrupt. */
+static ssize_t decode(JsonDecompressor *d, char *out, size_t room) {
+    if (d->format == JSON_COMPRESSION_GZIP) {
+        // Concatenated gzip members make up one stream, as with gunzip
+        if (d->frame_done) {
+            inflateReset(&d->z);
+            d->frame_done = 0;
+        }
+        d->z.next_in = d->in + d->in_pos;
+        d->z.avail_in = d->in_len - d->in_pos;
+        d->z.next_out = (unsigned char *)out;
+        d->z.avail_out = room;
+
+        int ret = inflate(&d->z, Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+            errno = EILSEQ;
+            return -1;
+        }
+        d->in_pos = d->in_len - d->z.avail_in;
+        d->frame_done = ret == Z_STREAM_END;
+        return room - d->z.avail_out;
+    }
+
+#ifdef JSON_DECOMPRESS_ZSTD
+    ZSTD_inBuffer input = { d->in, d->in_len, d->in_pos };
+    ZSTD_outBuffer output = { out, room, 0 };
+    size_t ret = ZSTD_decompressStream(d->zstd, &output, &input);
+    if (ZSTD_isError(ret)) {
+        errno = EILSEQ;
+        return -1;
+    }
+    d->in_pos = input.pos;
+    d->frame_done = ret == 0;
+    return output.pos;
+#else
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+/* Decompress into one slot until it is full or the input pauses with
+ * something produced. Returns 1 if more may follow, 0 at the end of the
+ * stream, or -1 with errno set. */
+static int fill_slot(JsonDecompressor *d, char *out, size_t *out_len) {
+    while (*out_len < DECOMPRESS_SLOT_BYTES) {
+        if (d->in_pos == d->in_len && !d->flushing) {
+            if (d->input_done) {
+                if (d->frame_done) return 0;
+                // Cut off in the middle of a member or frame
+                errno = EIO;
+                return -1;
+            }
+
+            ssize_t n = json_source_read_fd(d->fd, d->in, sizeof(d->in), *out_len > 0, &d->stop);
+            if (n == JSON_READ_PAUSED) return 1;
+            if (n < 0) return -1;
+            if (n == 0) {
+                d->input_done = 1;
+                continue;
+            }
+            d->in_len = n;
+            d->in_pos = 0;
+        }
+
+        size_t room = DECOMPRESS_SLOT_BYTES - *out_len;
+        ssize_t produced = decode(d, out + *out_len, room);
+        if (produced < 0) return -1;
+        *out_len += produced;
+        d->flushing = (size_t)produced == room;
+    }
+    return 1;
+}
+
+static void *decompress_main(void *arg) {
+    JsonDecompressor *d = arg;
+    int result = 1;
+
+    while (result > 0) {
+        pthread_mutex_lock(&d->lock);
+        while (d->count == DECOMPRESS_SLOTS && !d->stop) {
+            pthread_cond_wait(&d->changed, &d->lock);
+        }
+        int slot = (d->head + d->count) % DECOMPRESS_SLOTS;
+        int stop = d->stop;
+        pthread_mutex_unlock(&d->lock);
+        if (stop) break;
+
+        size_t len = 0;
+        result = fill_slot(d, d->slots[slot], &len);
+        int error = result < 0 ? errno : 0;
+
+        pthread_mutex_lock(&d->lock);
+        if (len > 0) {
+            d->slot_len[slot] = len;
+            d->count++;
+        }
+        if (result <= 0) {
+            d->finished = 1;
+            d->error = error;
+        }
+        pthread_cond_broadcast(&d->changed);
+        pthread_mutex_unlock(&d->lock);
+    }
+    return NULL;
+}
+
+static void decompress_free(JsonDecompressor *d) {
+    for (int i = 0; i < DECOMPRESS_SLOTS; i++) {
+        free(d->slots[i]);
+    }
+    if (d->format == JSON_COMPRESSION_GZIP) {
+        inflateEnd(&d->z);
+    }
+#ifdef JSON_DECOMPRESS_ZSTD
+    ZSTD_freeDStream(d->zstd);
+#endif
+    pthread_mutex_destroy(&d->lock);
+    pthread_cond_destroy(&d->changed);
+    free(d);
+}
+
+JsonDecompressor *json_decompress_start(int fd, JsonCompression format,
+                                        const void *prefix, size_t prefix_len) {
+    JsonDecompressor *d = calloc(1, sizeof(JsonDecompressor));
+    if (!d) return NULL;
+
+    d->format = format;
+    d->fd = fd;
+    memcpy(d->in, prefix, prefix_len);
+    d->in_len = prefix_len;
+    pthread_mutex_init(&d->lock, NULL);
+    pthread_cond_init(&d->changed, NULL);
+
+    int ok = 1;
+    for (int i = 0; i < DECOMPRESS_SLOTS; i++) {
+        d->slots[i] = malloc(DECOMPRESS_SLOT_BYTES);
+        if (!d->slots[i]) ok = 0;
+    }
+
+    if (format == JSON_COMPRESSION_GZIP) {
+        // 32 lets zlib take either a gzip or a zlib header
+        if (inflateInit2(&d->z, 15 + 32) != Z_OK) {
+            d->format = JSON_COMPRESSION_NONE;
+            ok = 0;
+        }
+    }
+#ifdef JSON_DECOMPRESS_ZSTD
+    if (format == JSON_COMPRESSION_ZSTD) {
+        d->zstd = ZSTD_createDStream();
+        if (!d->zstd) ok = 0;
+    }
+#endif
+
+    if (!ok || pthread_create(&d->thread, NULL, decompress_main, d) != 0) {
+        decompress_free(d);
+        errno = ENOMEM;
+        return NULL;
+    }
+    return d;
+}
+
+ssize_t json_decompress_read(JsonDecompressor *d, char *out, size_t room,
+                             int pending, const int *cancel) {
+    ssize_t result;
+
+    pthread_mutex_lock(&d->lock);
+    for (;;) {
+        if (d->count > 0) {
+            size_t n = d->slot_len[d->head] - d->head_pos;
+            if (n > room) n = room;
+            memcpy(out, d->slots[d->head] + d->head_pos, n);
+            d->head_pos += n;
+            if (d->head_pos == d->slot_len[d->head]) {
+                d->head = (d->head + 1) % DECOMPRESS_SLOTS;
+                d->count--;
+                d->head_pos = 0;
+                pthread_cond_broadcast(&d->changed);
+            }
+            result = n;
+            break;
+        }
+        if (d->finished) {
+            errno = d->error;
+            result = d->error ? -1 : 0;
+            break;
+        }
+        if (cancel && __atomic_load_n(cancel, __ATOMIC_RELAXED)) {
+            result = JSON_READ_PAUSED;
+            break;
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += DECOMPRESS_WAIT_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (pthread_cond_timedwait(&d->changed, &d->lock, &deadline) == ETIMEDOUT && pending) {
+            result = JSON_READ_PAUSED;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&d->lock);
+
+    return result;
+}
+
+void json_decompress_stop(JsonDecompressor *d) {
+    pthread_mutex_lock(&d->lock);
+    d->stop = 1;
+    pthread_cond_broadcast(&d->changed);
+    pthread_mutex_unlock(&d->lock);
+
+    pthread_join(d->thread, NULL);
+    decompress_free(d);
+}
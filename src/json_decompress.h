@@ -0,0 +1,48 @@
+#ifndef JSON_DECOMPRESS_H
+#define JSON_DECOMPRESS_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/* Compressed input, recognised by its first bytes rather than its name.
+ * gzip is always available; zstd needs a build with JSON_DECOMPRESS_ZSTD
+ * (make ZSTD=1). */
+typedef enum {
+    JSON_COMPRESSION_NONE,
+    JSON_COMPRESSION_GZIP,
+    JSON_COMPRESSION_ZSTD
+} JsonCompression;
+
+/* Bytes needed to tell the formats apart */
+#define JSON_COMPRESSION_MAGIC_LEN 4
+
+/* Returned by the readers below when they stopped waiting for input */
+#define JSON_READ_PAUSED (-2)
+
+typedef struct JsonDecompressor JsonDecompressor;
+
+JsonCompression json_compression_detect(const void *magic, size_t len);
+
+/* 1 if this build can decompress the format */
+int json_compression_supported(JsonCompression format);
+
+/* Decompress fd on a thread of its own, a few slots ahead of the reader,
+ * so that inflating overlaps with tokenizing. The first prefix_len bytes
+ * of the compressed stream, at most JSON_COMPRESSION_MAGIC_LEN, were
+ * already read from fd into prefix. fd stays owned by the caller and must
+ * stay open until json_decompress_stop. Returns NULL with errno set on
+ * failure. */
+JsonDecompressor *json_decompress_start(int fd, JsonCompression format,
+                                        const void *prefix, size_t prefix_len);
+
+/* Copy up to room decompressed bytes to out. Waits for the pump thread
+ * unless pending is set and it has paused, or *cancel becomes nonzero;
+ * both return JSON_READ_PAUSED. Returns the byte count, 0 once the stream
+ * is over, or -1 with errno set if it is corrupt or could not be read. */
+ssize_t json_decompress_read(JsonDecompressor *decompressor, char *out, size_t room,
+                             int pending, const int *cancel);
+
+/* Stop the pump thread and free everything */
+void json_decompress_stop(JsonDecompressor *decompressor);
+
+#endif /* JSON_DECOMPRESS_H */
@@ -0,0 +1,204 @@
+#include <stdlib.h>
+
+#define JSON_INDEX_IMPLEMENTATION
+#include "json_index.h"
+
+/* Parse JSON into a token array that grows geometrically until the document fits */
+int parse_tokens(const char *js, size_t len, jsmntok_t **out_tokens, int **out_parents) {
+    // Offsets past the configured width would silently wrap
+    if (len > (size_t)JSMN_OFFSET_MAX) return JSMN_ERROR_NOMEM;
+
+    jsmn_parser parser;
+    jsmn_init(&parser);
+
+    unsigned int capacity = INITIAL_TOKENS;
+    jsmntok_t *tokens = malloc(sizeof(jsmntok_t) * capacity);
+    int *parents = malloc(sizeof(int) * capacity);
+    if (!tokens || !parents) {
+        free(tokens);
+        free(parents);
+        return JSMN_ERROR_NOMEM;
+    }
+
+    int count;
+    parser.parents = parents;
+    while ((count = jsmn_parse(&parser, js, len, tokens, capacity)) == JSMN_ERROR_NOMEM) {
+        // jsmn leaves the parser positioned on the token it could not store,
+        // so parsing resumes where it stopped once there is room again
+        if (capacity > JSON_INDEX_MAX_TOKENS / 2) break;
+        capacity *= 2;
+        jsmntok_t *grown = realloc(tokens, sizeof(jsmntok_t) * capacity);
+        if (grown) tokens = grown;
+        int *grown_parents = realloc(parents, sizeof(int) * capacity);
+        if (grown_parents) parents = grown_parents;
+        if (!grown || !grown_parents) break;
+        parser.parents = parents;
+    }
+
+    if (count < 0) {
+        free(tokens);
+        free(parents);
+        return count;
+    }
+
+    // Give back the slack left over from the last doubling
+    if (count > 0) {
+        jsmntok_t *shrunk = realloc(tokens, sizeof(jsmntok_t) * count);
+        if (shrunk) tokens = shrunk;
+        int *shrunk_parents = realloc(parents, sizeof(int) * count);
+        if (shrunk_parents) parents = shrunk_parents;
+    }
+
+    *out_tokens = tokens;
+    *out_parents = parents;
+    return count;
+}
+
+/* Depth of a single token, given those of its predecessors, and its parent
+ * link turned into its enclosing container. Applying it twice changes
+ * nothing. */
+static void depth_of(const jsmntok_t *tokens, int i, int *parents, uint16_t *depths) {
+    int p = parents[i];
+    int depth = p >= 0 ? depths[p] & JSON_INDEX_MAX_DEPTH : 0;
+
+    if (p < 0) {
+        depths[i] = 0;
+    } else if (tokens[p].type == JSMN_OBJECT || tokens[p].type == JSMN_ARRAY) {
+        depths[i] = depth < JSON_INDEX_MAX_DEPTH ? depth + 1 : JSON_INDEX_MAX_DEPTH;
+    } else {
+        // Object values are linked to their key, which sits at the
+        // same depth and shares the key's container
+        depths[i] = depth;
+        parents[i] = parents[p];
+    }
+}
+
+/* Calculate token depths and container parents for indentation */
+void calculate_depths(const jsmntok_t *tokens, int count, int *parents, uint16_t *depths) {
+    for (int i = 0; i < count; i++) {
+        depth_of(tokens, i, parents, depths);
+    }
+}
+
+static int grow(void **array, size_t elem_size, int capacity) {
+    void *grown = realloc(*array, elem_size * (capacity > 0 ? capacity : 1));
+    if (!grown) return -1;
+    *array = grown;
+    return 0;
+}
+
+void json_index_init(JsonIndex *index) {
+    index->count = 0;
+    index->capacity = 0;
+    index->parents = index->next = NULL;
+    index->nodes = NULL;
+    index->borrowed = 0;
+    index->open = NULL;
+    index->open_count = 0;
+    index->open_capacity = 0;
+}
+
+void json_index_borrow(JsonIndex *index) {
+    json_index_init(index);
+    index->borrowed = 1;
+}
+
+int json_index_reserve(JsonIndex *index, int capacity) {
+    if (capacity <= index->capacity) return 0;
+    if (index->borrowed) return -1;
+
+    if (grow((void **)&index->parents, sizeof(int), capacity) < 0 ||
+        grow((void **)&index->next, sizeof(int), capacity) < 0 ||
+        grow((void **)&index->nodes, sizeof(uint16_t), capacity) < 0) {
+        return -1;
+    }
+
+    index->capacity = capacity;
+    return 0;
+}
+
+/* Index tokens [index->count, count). Each new token first settles the
+ * subtree end of every open container it is not nested in; what is left on
+ * the open stack is exactly its chain of enclosing containers. */
+int json_index_extend(JsonIndex *index, const jsmntok_t *tokens, int count) {
+    if (json_index_reserve(index, count) < 0) return -1;
+
+    for (int i = index->count; i < count; i++) {
+        int link = index->parents[i];
+        depth_of(tokens, i, index->parents, index->nodes);
+
+        int p = index->parents[i];
+        while (index->open_count > 0 && index->open[index->open_count - 1] != p) {
+            index->next[index->open[--index->open_count]] = i;
+        }
+
+        jsmntype_t type = tokens[i].type;
+        uint16_t flags = __builtin_ctz(type) << JSON_INDEX_TYPE_SHIFT;
+        if (p >= 0 && link != p) {
+            // An object value, linked to its key
+            if (type == JSMN_STRING || type == JSMN_PRIMITIVE) {
+                flags |= JSON_INDEX_INLINE;
+            }
+        } else if (p >= 0 && token_type(index, p) == JSMN_OBJECT) {
+            flags |= JSON_INDEX_KEY;
+        }
+        index->nodes[i] |= flags;
+        index->next[i] = i + 1;
+
+        if (type == JSMN_OBJECT || type == JSMN_ARRAY) {
+            if (index->open_count == index->open_capacity) {
+                int capacity = index->open_capacity ? index->open_capacity * 2 : 64;
+                if (grow((void **)&index->open, sizeof(int), capacity) < 0) {
+                    index->count = i;
+                    return -1;
+                }
+                index->open_capacity = capacity;
+            }
+            index->open[index->open_count++] = i;
+        }
+    }
+    index->count = count;
+
+    // Containers that may still grow span everything indexed so far
+    for (int k = 0; k < index->open_count; k++) {
+        index->next[index->open[k]] = count;
+    }
+
+    return 0;
+}
+
+/* Close out every container still open once the last token is known */
+void json_index_finish(JsonIndex *index) {
+    while (index->open_count > 0) {
+        index->next[index->open[--index->open_count]] = index->count;
+    }
+    free(index->open);
+    index->open = NULL;
+    index->open_capacity = 0;
+}
+
+void json_index_reset(JsonIndex *index) {
+    index->count = 0;
+    index->open_count = 0;
+}
+
+/* Build parent, subtree end and key/value tables for all tokens */
+int json_index_build(JsonIndex *index, const jsmntok_t *tokens, int count) {
+    if (json_index_extend(index, tokens, count) < 0) {
+        json_index_free(index);
+        return -1;
+    }
+    json_index_finish(index);
+
+    return 0;
+}
+
+void json_index_free(JsonIndex *index) {
+    if (!index->borrowed) {
+        free(index->parents);
+        free(index->next);
+        free(index->nodes);
+    }
+    free(index->open);
+    json_index_init(index);
+}
@@ -0,0 +1,124 @@
+#ifndef JSON_INDEX_H
+#define JSON_INDEX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Every translation unit must see the same jsmn configuration, since
+ * JSMN_PARENT_LINKS changes the layout of jsmn_parser. Only json_index.c
+ * compiles the tokenizer itself. */
+#define JSMN_PARENT_LINKS
+#ifndef JSON_INDEX_IMPLEMENTATION
+#define JSMN_HEADER
+#endif
+#include "jsmn.h"
+
+#define INITIAL_TOKENS 2048
+/* Token indices are plain ints throughout the viewer */
+#define JSON_INDEX_MAX_TOKENS 0x7fffffffu
+
+/* Per-token node word. The low bits hold the indentation depth, the next
+ * two the token's role, and the top two its jsmntype_t as a bit position,
+ * so that tree walks can tell containers apart without touching the token
+ * offsets. */
+#define JSON_INDEX_DEPTH_BITS 12
+#define JSON_INDEX_KEY    0x1000    /* string token naming an object member */
+#define JSON_INDEX_INLINE 0x2000    /* string/primitive value drawn on its key's line */
+#define JSON_INDEX_TYPE_SHIFT 14
+
+/* Depths saturate here; deeper tokens are drawn at this indentation */
+#define JSON_INDEX_MAX_DEPTH ((1 << JSON_INDEX_DEPTH_BITS) - 1)
+
+/* Structural side table built alongside parsing, so that tree navigation
+ * never has to re-walk the token array. The tables a walk reads together
+ * are kept narrow: 10 bytes per token next to the 12 of jsmntok_t. */
+typedef struct {
+    int count;              /* tokens indexed so far */
+    int capacity;
+    int *parents;           /* jsmn's parent links until indexed, then the
+                               enclosing container, -1 at top level */
+    int *next;              /* first token after this token's subtree */
+    uint16_t *nodes;        /* depth, JSON_INDEX_* bits and type */
+    int borrowed;           /* tables belong to the caller, see json_index_borrow */
+
+    /* Build state: the chain of containers enclosing the last token. Their
+     * subtree end is provisional until a token outside them shows up. */
+    int *open;
+    int open_count;
+    int open_capacity;
+} JsonIndex;
+
+/* Parse JSON into a token array that grows geometrically until the document
+ * fits, with jsmn's parent link of every token in out_parents. Returns the
+ * token count, or a negative jsmnerr on failure. */
+int parse_tokens(const char *js, size_t len, jsmntok_t **out_tokens, int **out_parents);
+
+/* Compute indentation depth of every token in a single forward pass over
+ * the parent links, turning each link into the token's enclosing container
+ * in place. A token at top level has depth 0 and parent -1. Only the low
+ * JSON_INDEX_DEPTH_BITS of a depth are read back, so depths may be node
+ * words. */
+void calculate_depths(const jsmntok_t *tokens, int count, int *parents, uint16_t *depths);
+
+/* Incremental construction, for documents that are still being parsed:
+ * extend indexes every token from index->count up to count, and finish
+ * settles the subtree ends still left open. The tokenizer writes its
+ * parent links straight into index->parents, so it must be pointed there
+ * before every jsmn_parse, and the index reserved as far as the tokens. */
+void json_index_init(JsonIndex *index);
+int json_index_reserve(JsonIndex *index, int capacity);
+int json_index_extend(JsonIndex *index, const jsmntok_t *tokens, int count);
+void json_index_finish(JsonIndex *index);
+
+/* Start out empty on tables the caller places itself, in memory the index
+ * does not own, such as an arena or a mapped sidecar. The caller sets the
+ * table pointers and capacity; reserve never grows them and free leaves
+ * them alone. */
+void json_index_borrow(JsonIndex *index);
+
+/* Forget every token but keep the tables, to index another document */
+void json_index_reset(JsonIndex *index);
+
+/* Build the full structural index in one go, once the tokenizer has
+ * filled in the parent links of all count tokens. Returns 0, or -1 if out
+ * of memory. */
+int json_index_build(JsonIndex *index, const jsmntok_t *tokens, int count);
+void json_index_free(JsonIndex *index);
+
+/* Skip to next sibling token */
+static inline int skip_token(const JsonIndex *index, int token_idx) {
+    return index->next[token_idx];
+}
+
+static inline int token_depth(const JsonIndex *index, int token_idx) {
+    return index->nodes[token_idx] & JSON_INDEX_MAX_DEPTH;
+}
+
+static inline int is_object_key(const JsonIndex *index, int token_idx) {
+    return index->nodes[token_idx] & JSON_INDEX_KEY;
+}
+
+static inline int is_inline_value(const JsonIndex *index, int token_idx) {
+    return index->nodes[token_idx] & JSON_INDEX_INLINE;
+}
+
+static inline jsmntype_t token_type(const JsonIndex *index, int token_idx) {
+    return (jsmntype_t)(1 << (index->nodes[token_idx] >> JSON_INDEX_TYPE_SHIFT));
+}
+
+static inline int is_container(const JsonIndex *index, int token_idx) {
+    return token_type(index, token_idx) & (JSMN_OBJECT | JSMN_ARRAY);
+}
+
+/* Whether the byte at pos of raw text is escaped, going by the parity of
+ * the backslashes before it; for scanners that skip strings without
+ * tokenizing them */
+static inline int json_escaped(const char *js, size_t pos) {
+    size_t run = 0;
+    while (run < pos && js[pos - run - 1] == '\\') {
+        run++;
+    }
+    return run & 1;
+}
+
+#endif /* JSON_INDEX_H */
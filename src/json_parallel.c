@@ -0,0 +1,379 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "json_parallel.h"
+
+/* Outer containers a segment may close before its table has to grow */
+#define INITIAL_OUTER 64
+
+typedef struct {
+    const char *js;
+    size_t len;                 /* of the whole input */
+
+    /* Quote pass: a slice of the round, whether it starts inside a
+     * string, and the unescaped quotes in it */
+    size_t slice_start;
+    size_t slice_end;
+    size_t quotes;
+    int in_string;
+
+    /* Tokenizing pass: the bytes from start to end and their tokens,
+     * linked within the segment or to outer levels */
+    size_t start;
+    size_t end;
+    jsmn_parser parser;
+    jsmntok_t *tokens;
+    int *parents;
+    unsigned int capacity;
+    jsmn_outer *outer;
+    unsigned int outer_capacity;
+    int result;
+
+    /* Stitching pass: where the tokens go, and the token each outer level
+     * turned out to be, -1 for top level */
+    jsmntok_t *out_tokens;
+    int *out_parents;
+    int base;
+    int *levels;
+} JsonSegment;
+
+struct JsonRound {
+    size_t len;
+    size_t start;
+    size_t end;
+    int count;
+    int segment_count;
+    JsonSegment segments[JSON_PARALLEL_MAX_THREADS];
+};
+
+static int thread_override;
+
+int json_parallel_threads(void) {
+    if (thread_override > 0) return thread_override;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    return cpus > JSON_PARALLEL_MAX_THREADS ? JSON_PARALLEL_MAX_THREADS : (int)cpus;
+}
+
+void json_parallel_set_threads(int threads) {
+    thread_override = threads > JSON_PARALLEL_MAX_THREADS ? JSON_PARALLEL_MAX_THREADS : threads;
+}
+
+/* Run task on every segment at once, the first on the calling thread */
+static void run_segments(JsonRound *round, void *(*task)(void *)) {
+    pthread_t threads[JSON_PARALLEL_MAX_THREADS];
+    int started[JSON_PARALLEL_MAX_THREADS];
+
+    for (int i = 1; i < round->segment_count; i++) {
+        started[i] = pthread_create(&threads[i], NULL, task, &round->segments[i]) == 0;
+    }
+    task(&round->segments[0]);
+    for (int i = 1; i < round->segment_count; i++) {
+        // A segment no thread could be started for is done here instead
+        if (started[i]) {
+            pthread_join(threads[i], NULL);
+        } else {
+            task(&round->segments[i]);
+        }
+    }
+}
+
+/* The first offset from pos that does not follow a backslash */
+static size_t unescaped(const char *js, size_t len, size_t pos) {
+    while (pos < len && js[pos - 1] == '\\') {
+        pos++;
+    }
+    return pos;
+}
+
+/* The first offset after a ',' outside strings, from pos on, or len */
+static size_t next_boundary(const char *js, size_t len, size_t pos, int in_string) {
+    while (pos < len) {
+        if (in_string) {
+            const char *quote = memchr(js + pos, '"', len - pos);
+            if (!quote) return len;
+            pos = quote - js + 1;
+            in_string = json_escaped(js, pos - 1);
+            continue;
+        }
+        while (pos < len && js[pos] != ',' && js[pos] != '"') {
+            pos++;
+        }
+        if (pos < len && js[pos] == ',') return pos + 1;
+        in_string = 1;
+        pos++;
+    }
+    return len;
+}
+
+static void *count_quotes(void *arg) {
+    JsonSegment *segment = arg;
+    const char *p = segment->js + segment->slice_start;
+    const char *end = segment->js + segment->slice_end;
+
+    segment->quotes = 0;
+    while (p < end && (p = memchr(p, '"', end - p)) != NULL) {
+        if (!json_escaped(segment->js, p - segment->js)) segment->quotes++;
+        p++;
+    }
+    return NULL;
+}
+
+static void *find_start(void *arg) {
+    JsonSegment *segment = arg;
+    segment->start = next_boundary(segment->js, segment->len, segment->slice_start,
+                                   segment->in_string);
+    return NULL;
+}
+
+static void *tokenize(void *arg) {
+    JsonSegment *segment = arg;
+    jsmn_parser *parser = &segment->parser;
+    int result = JSMN_ERROR_NOMEM;
+
+    // Enough for all but the densest input, so the tables rarely move
+    segment->capacity = (segment->end - segment->start) / 4 + INITIAL_TOKENS;
+    segment->outer_capacity = INITIAL_OUTER;
+    segment->tokens = malloc(sizeof(jsmntok_t) * segment->capacity);
+    segment->parents = malloc(sizeof(int) * segment->capacity);
+    segment->outer = malloc(sizeof(jsmn_outer) * segment->outer_capacity);
+    if (!segment->tokens || !segment->parents || !segment->outer) {
+        segment->result = JSMN_ERROR_NOMEM;
+        return NULL;
+    }
+    segment->outer[0].size = 0;
+
+    jsmn_init_segment(parser, segment->start);
+    for (;;) {
+        parser->parents = segment->parents;
+        parser->outer = segment->outer;
+        parser->outer_capacity = segment->outer_capacity;
+        result = jsmn_parse(parser, segment->js, segment->end, segment->tokens, segment->capacity);
+        if (result != JSMN_ERROR_NOMEM) break;
+
+        // Out of room either for tokens or for outer levels
+        if (parser->toknext < segment->capacity) {
+            jsmn_outer *outer = realloc(segment->outer,
+                                        sizeof(jsmn_outer) * segment->outer_capacity * 2);
+            if (!outer) break;
+            segment->outer = outer;
+            segment->outer_capacity *= 2;
+            continue;
+        }
+        if (segment->capacity > JSON_INDEX_MAX_TOKENS / 2) break;
+        jsmntok_t *tokens = realloc(segment->tokens, sizeof(jsmntok_t) * segment->capacity * 2);
+        if (tokens) segment->tokens = tokens;
+        int *parents = realloc(segment->parents, sizeof(int) * segment->capacity * 2);
+        if (parents) segment->parents = parents;
+        if (!tokens || !parents) break;
+        segment->capacity *= 2;
+    }
+
+    // Only a ':' right at the start makes a top-level token here, and the
+    // key it names lies in an earlier segment, out of reach of the links
+    for (unsigned int i = 0; result >= 0 && i < parser->toknext; i++) {
+        if (segment->parents[i] == -1) result = JSMN_ERROR_INVAL;
+    }
+    segment->result = result;
+    return NULL;
+}
+
+JsonRound *json_round_tokenize(const char *js, size_t len, size_t pos) {
+    int threads = json_parallel_threads();
+    if (threads < 2 || pos >= len || len - pos < JSON_PARALLEL_MIN_BYTES) return NULL;
+
+    JsonRound *round = calloc(1, sizeof(JsonRound));
+    if (!round) return NULL;
+
+    // The last round takes whatever is left rather than a sliver of it
+    size_t bytes = (size_t)threads * JSON_PARALLEL_SEGMENT_BYTES;
+    size_t end = (len - pos < bytes + JSON_PARALLEL_SEGMENT_BYTES) ? len : pos + bytes;
+    size_t slice = (end - pos) / threads;
+
+    round->len = len;
+    round->segment_count = threads;
+
+    // No slice starts on an escaped byte, so each can count its quotes
+    // without looking at the one before
+    for (int i = 0; i < threads; i++) {
+        JsonSegment *segment = &round->segments[i];
+        segment->js = js;
+        segment->len = len;
+        segment->slice_start = pos;
+        if (i > 0) {
+            segment->slice_start = unescaped(js, len, pos + i * slice);
+            if (segment->slice_start < segment[-1].slice_start) {
+                segment->slice_start = segment[-1].slice_start;
+            }
+        }
+    }
+    size_t slice_end = end < len ? unescaped(js, len, end) : len;
+    if (slice_end < round->segments[threads - 1].slice_start) {
+        slice_end = round->segments[threads - 1].slice_start;
+    }
+    for (int i = 0; i < threads; i++) {
+        round->segments[i].slice_end = i + 1 < threads ? round->segments[i + 1].slice_start
+                                                       : slice_end;
+    }
+    run_segments(round, count_quotes);
+
+    // A slice starts inside a string after an odd number of quotes
+    int in_string = 0;
+    for (int i = 0; i < threads; i++) {
+        round->segments[i].in_string = in_string;
+        in_string ^= round->segments[i].quotes & 1;
+    }
+    run_segments(round, find_start);
+    round->end = end < len ? next_boundary(js, len, slice_end, in_string) : len;
+
+    // A boundary found past the next one leaves an empty segment between
+    for (int i = 0; i < threads; i++) {
+        JsonSegment *segment = &round->segments[i];
+        if (i > 0 && segment->start < segment[-1].start) segment->start = segment[-1].start;
+        if (segment->start > round->end) segment->start = round->end;
+    }
+    for (int i = 0; i < threads; i++) {
+        round->segments[i].end = i + 1 < threads ? round->segments[i + 1].start : round->end;
+    }
+    round->start = round->segments[0].start;
+    run_segments(round, tokenize);
+
+    for (int i = 0; i < threads; i++) {
+        if (round->segments[i].result < 0) {
+            json_round_free(round);
+            return NULL;
+        }
+        round->count += round->segments[i].parser.toknext;
+    }
+    return round;
+}
+
+size_t json_round_start(const JsonRound *round) {
+    return round->start;
+}
+
+size_t json_round_end(const JsonRound *round) {
+    return round->end;
+}
+
+int json_round_tokens(const JsonRound *round) {
+    return round->count;
+}
+
+static int is_open(const jsmntok_t *token) {
+    return token->start != -1 && token->end == -1;
+}
+
+static void *copy_segment(void *arg) {
+    JsonSegment *segment = arg;
+    int count = segment->parser.toknext;
+
+    memcpy(segment->out_tokens + segment->base, segment->tokens, sizeof(jsmntok_t) * count);
+    for (int i = 0; i < count; i++) {
+        int parent = segment->parents[i];
+        segment->out_parents[segment->base + i] =
+            parent >= 0 ? segment->base + parent : segment->levels[JSMN_OUTER(0) - parent];
+    }
+    return NULL;
+}
+
+int json_round_stitch(JsonRound *round, jsmn_parser *parser, jsmntok_t *tokens, int *parents) {
+    int depth = 0;
+    for (int i = parser->toksuper; i >= 0; i = parents[i]) {
+        if (is_open(&tokens[i])) depth++;
+    }
+
+    // The containers open so far, outermost first, as each segment finds
+    // them: it closes some and leaves others of its own open
+    int *stack = malloc(sizeof(int) * (depth + round->count + 1));
+    unsigned char *types = malloc(depth + round->count + 1);
+    int result = (stack && types) ? 0 : -1;
+    int n = depth;
+    for (int i = parser->toksuper; result == 0 && i >= 0; i = parents[i]) {
+        if (is_open(&tokens[i])) {
+            n--;
+            stack[n] = i;
+            types[n] = tokens[i].type;
+        }
+    }
+
+    int base = parser->toknext;
+    for (int s = 0; s < round->segment_count && result == 0; s++) {
+        JsonSegment *segment = &round->segments[s];
+        jsmn_outer *outer = segment->parser.outer;
+        int closed = segment->parser.outer_closed;
+        int top = segment->parser.toksuper;
+
+        segment->levels = malloc(sizeof(int) * (closed + 1));
+        // Ending on a ',' leaves a container superior, never a key
+        if (!segment->levels || closed > depth || (top >= 0 && !is_open(&segment->tokens[top]))) {
+            result = -1;
+            break;
+        }
+        for (int k = 0; k <= closed; k++) {
+            segment->levels[k] = k < depth ? stack[depth - 1 - k] : -1;
+            // A bracket has to match the container it closes
+            if (k < closed && (int)types[depth - 1 - k] != outer[k].type) result = -1;
+        }
+        depth -= closed;
+
+        for (int i = top; i >= 0; i = segment->parents[i]) {
+            if (is_open(&segment->tokens[i])) depth++;
+        }
+        n = depth;
+        for (int i = top; i >= 0; i = segment->parents[i]) {
+            if (is_open(&segment->tokens[i])) {
+                n--;
+                stack[n] = base + i;
+                types[n] = segment->tokens[i].type;
+            }
+        }
+
+        segment->out_tokens = tokens;
+        segment->out_parents = parents;
+        segment->base = base;
+        base += segment->parser.toknext;
+    }
+
+    // The end of the input leaves nothing open, or jsmn has an error to
+    // report about it
+    if (result == 0 && round->end == round->len && depth > 0) result = -1;
+    if (result == 0) {
+        run_segments(round, copy_segment);
+
+        // What the segments did to containers opened before them, applied
+        // once those are all in place
+        for (int s = 0; s < round->segment_count; s++) {
+            JsonSegment *segment = &round->segments[s];
+            jsmn_outer *outer = segment->parser.outer;
+            for (int k = 0; k <= (int)segment->parser.outer_closed; k++) {
+                int tok = segment->levels[k];
+                if (tok < 0) continue;
+                unsigned int size = tokens[tok].size + outer[k].size;
+                tokens[tok].size = size < JSMN_SIZE_MAX ? size : JSMN_SIZE_MAX;
+                if (k < (int)segment->parser.outer_closed) tokens[tok].end = outer[k].end;
+            }
+        }
+
+        parser->pos = round->end;
+        parser->toknext = base;
+        parser->toksuper = depth > 0 ? stack[depth - 1] : -1;
+    }
+
+    free(stack);
+    free(types);
+    return result;
+}
+
+void json_round_free(JsonRound *round) {
+    if (!round) return;
+    for (int i = 0; i < round->segment_count; i++) {
+        free(round->segments[i].tokens);
+        free(round->segments[i].parents);
+        free(round->segments[i].outer);
+        free(round->segments[i].levels);
+    }
+    free(round);
+}
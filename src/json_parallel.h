@@ -0,0 +1,59 @@
+#ifndef JSON_PARALLEL_H
+#define JSON_PARALLEL_H
+
+#include "json_index.h"
+
+/* Tokenizing a large document on every core. The input is taken a round
+ * at a time; a round is split into one segment per thread, each starting
+ * right after a ',' outside any string, and the segments are tokenized
+ * concurrently in jsmn's segment mode. Where strings begin and end at the
+ * split points comes from a prefix pass over quote parity, which only
+ * holds for valid JSON, so a split is only trusted once the segment before
+ * it has parsed cleanly up to it. The segments are then stitched onto the
+ * parser's arrays in order, resolving their links and child counts into
+ * the containers opened before them. A round that does not hold up is
+ * dropped and the caller tokenizes the same bytes sequentially, which also
+ * reports any error where jsmn would. */
+
+/* Input each thread takes per round */
+#define JSON_PARALLEL_SEGMENT_BYTES (8 << 20)
+/* Less input than this left is not worth splitting */
+#define JSON_PARALLEL_MIN_BYTES (2 * JSON_PARALLEL_SEGMENT_BYTES)
+#define JSON_PARALLEL_MAX_THREADS 64
+
+typedef struct JsonRound JsonRound;
+
+/* Threads per round: one per online CPU unless set otherwise */
+int json_parallel_threads(void);
+
+/* Use this many threads per round from now on; 0 goes back to one per
+ * online CPU */
+void json_parallel_set_threads(int threads);
+
+/* Tokenize the next round of js[0, len) from pos, where a parser stopped
+ * between tokens, without touching the parser. The round ends after about
+ * JSON_PARALLEL_SEGMENT_BYTES per thread, or with the input if less than
+ * that would be left. Returns NULL if a segment fails to parse or on
+ * running out of memory. */
+JsonRound *json_round_tokenize(const char *js, size_t len, size_t pos);
+
+/* Where the first segment starts. The parser has to be brought there the
+ * usual way before the round can be stitched on. */
+size_t json_round_start(const JsonRound *round);
+
+/* Where the last segment ends */
+size_t json_round_end(const JsonRound *round);
+
+/* Tokens in all segments */
+int json_round_tokens(const JsonRound *round);
+
+/* Append the round to the tokens and parent links of a parser positioned
+ * at json_round_start, which must have room for json_round_tokens more.
+ * Leaves the parser at json_round_end. Returns 0, or -1 with nothing
+ * written if the round does not follow from the parser's state or leaves
+ * containers open at the end of the input. */
+int json_round_stitch(JsonRound *round, jsmn_parser *parser, jsmntok_t *tokens, int *parents);
+
+void json_round_free(JsonRound *round);
+
+#endif /* JSON_PARALLEL_H */
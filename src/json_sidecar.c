@@ -0,0 +1,308 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bitset.h"
+#include "json_sidecar.h"
+
+#define SIDECAR_MAGIC "JVIDX03"
+/* The content hash covers this many evenly spaced blocks plus the last one */
+#define SIDECAR_SAMPLES 16
+#define SIDECAR_SAMPLE_BYTES 4096
+#define SIDECAR_ALIGN 64
+/* Tables are copied out in steps this large, checking for cancellation */
+#define SIDECAR_COPY_CHUNK (64 << 20)
+
+enum {
+    SECTION_TOKENS,
+    SECTION_PARENTS,
+    SECTION_NEXT,
+    SECTION_NODES,
+    SECTION_TREE,
+    SECTION_SHOWN,
+    SECTION_COUNT
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t token_size;    /* sizeof(jsmntok_t); compact and wide builds differ */
+    int32_t token_count;
+    int32_t total_lines;    /* of the fully expanded layout */
+    int32_t top_bit;
+    uint64_t source_size;
+    int64_t source_mtime_sec;
+    int64_t source_mtime_nsec;
+    uint64_t source_hash;
+    uint64_t offsets[SECTION_COUNT];
+} SidecarHeader;
+
+static size_t section_size(int section, int count) {
+    switch (section) {
+        case SECTION_TOKENS:
+            return sizeof(jsmntok_t) * (size_t)count;
+        case SECTION_NODES:
+            return sizeof(uint16_t) * (size_t)count;
+        case SECTION_TREE:
+            return sizeof(int) * (BITSET_WORDS(count) + 1);
+        case SECTION_SHOWN:
+            return sizeof(uint64_t) * BITSET_WORDS(count);
+        default:
+            return sizeof(int) * (size_t)count;
+    }
+}
+
+double json_sidecar_token_bytes(void) {
+    // Large enough for the per-word tables to average out
+    int count = 1 << 20;
+    size_t bytes = 0;
+
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        bytes += section_size(i, count);
+    }
+    return (double)bytes / count;
+}
+
+/* Place the tables one after the other behind the header. Returns the
+ * size of the whole file. */
+static size_t layout(SidecarHeader *header, int count) {
+    size_t offset = sizeof(SidecarHeader);
+
+    for (int i = 0; i < SECTION_COUNT; i++) {
+        offset = (offset + SIDECAR_ALIGN - 1) & ~(size_t)(SIDECAR_ALIGN - 1);
+        header->offsets[i] = offset;
+        offset += section_size(i, count);
+    }
+    return offset;
+}
+
+/* FNV-1a over a few blocks spread across the file; enough to catch a file
+ * rewritten in place with its mtime restored, without reading all of it */
+static uint64_t sample_hash(const char *data, size_t len) {
+    uint64_t hash = 14695981039346656037ULL;
+    size_t span = len > SIDECAR_SAMPLE_BYTES ? len - SIDECAR_SAMPLE_BYTES : 0;
+
+    for (int i = 0; i <= SIDECAR_SAMPLES; i++) {
+        size_t at = i == SIDECAR_SAMPLES ? span : span / SIDECAR_SAMPLES * i;
+        size_t end = at + SIDECAR_SAMPLE_BYTES < len ? at + SIDECAR_SAMPLE_BYTES : len;
+
+        for (; at < end; at++) {
+            hash ^= (unsigned char)data[at];
+            hash *= 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+static void describe_source(SidecarHeader *header, const JsonSource *source) {
+    header->source_size = source->len;
+    header->source_mtime_sec = source->mtime.tv_sec;
+    header->source_mtime_nsec = source->mtime.tv_nsec;
+    header->source_hash = sample_hash(source->data, source->len);
+}
+
+char *json_sidecar_path(const char *path) {
+    size_t len = strlen(path);
+    char *sidecar = malloc(len + sizeof(SIDECAR_SUFFIX));
+    if (!sidecar) return NULL;
+
+    memcpy(sidecar, path, len);
+    memcpy(sidecar + len, SIDECAR_SUFFIX, sizeof(SIDECAR_SUFFIX));
+    return sidecar;
+}
+
+/* Was the sidecar written by this build, completely, for this very file? */
+static int header_matches(const SidecarHeader *header, size_t file_len,
+                          const JsonSource *source) {
+    SidecarHeader expected;
+
+    if (memcmp(header->magic, SIDECAR_MAGIC, sizeof(header->magic)) != 0 ||
+        header->token_size != sizeof(jsmntok_t) || header->token_count < 0) {
+        return 0;
+    }
+
+    memset(&expected, 0, sizeof(expected));
+    if (layout(&expected, header->token_count) != file_len ||
+        memcmp(expected.offsets, header->offsets, sizeof(expected.offsets)) != 0) {
+        return 0;
+    }
+
+    // Cheap checks first; the hash touches a few pages of the file
+    describe_source(&expected, source);
+    return header->source_size == expected.source_size &&
+           header->source_mtime_sec == expected.source_mtime_sec &&
+           header->source_mtime_nsec == expected.source_mtime_nsec &&
+           header->source_hash == expected.source_hash;
+}
+
+int json_sidecar_map(JsonViewer *viewer, const char *sidecar_path) {
+    const JsonSource *source = viewer->source;
+    if (!source || !source->mapped) return -1;
+
+    int fd = open(sidecar_path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SidecarHeader)) {
+        close(fd);
+        return -1;
+    }
+
+    // Collapsing a node writes to the line tables; private pages keep the
+    // file itself untouched
+    void *map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    const SidecarHeader *header = map;
+    if (!header_matches(header, st.st_size, source)) {
+        munmap(map, st.st_size);
+        return -1;
+    }
+
+    // Only the collapsed and match bitsets of a fresh viewer go into its
+    // arena; every other table points into the mapping
+    int count = header->token_count;
+    viewer->sidecar_map = map;
+    viewer->sidecar_len = st.st_size;
+    if (viewer_reserve(viewer, count) < 0) {
+        json_sidecar_unmap(viewer);
+        return -1;
+    }
+
+    char *base = map;
+    viewer->tokens = (jsmntok_t *)(base + header->offsets[SECTION_TOKENS]);
+    viewer->token_count = count;
+    viewer->parsed_len = source->len;
+
+    JsonIndex *index = &viewer->index;
+    index->count = count;
+    index->parents = (int *)(base + header->offsets[SECTION_PARENTS]);
+    index->next = (int *)(base + header->offsets[SECTION_NEXT]);
+    index->nodes = (uint16_t *)(base + header->offsets[SECTION_NODES]);
+
+    VisibleLines *lines = &viewer->lines;
+    lines->count = count;
+    lines->total = header->total_lines;
+    lines->blocks = BITSET_WORDS(count);
+    lines->top_bit = header->top_bit;
+    lines->tree = (int *)(base + header->offsets[SECTION_TREE]);
+    lines->shown = (uint64_t *)(base + header->offsets[SECTION_SHOWN]);
+    return 0;
+}
+
+void json_sidecar_unmap(JsonViewer *viewer) {
+    if (!viewer->sidecar_map) return;
+
+    munmap(viewer->sidecar_map, viewer->sidecar_len);
+    viewer->sidecar_map = NULL;
+    viewer->sidecar_len = 0;
+
+    // The tables were only borrowed from the mapping; what is left for
+    // viewer_cleanup to free is the arena
+    viewer->tokens = NULL;
+    viewer->token_count = viewer->token_capacity = 0;
+    json_index_free(&viewer->index);
+    visible_lines_free(&viewer->lines);
+}
+
+static int save_cancelled(JsonViewer *viewer) {
+    pthread_mutex_lock(&viewer->lock);
+    int cancelled = viewer->cancel_load;
+    pthread_mutex_unlock(&viewer->lock);
+    return cancelled;
+}
+
+static int copy_section(JsonViewer *viewer, char *dst, const void *src, size_t len) {
+    for (size_t done = 0; done < len; done += SIDECAR_COPY_CHUNK) {
+        if (save_cancelled(viewer)) return -1;
+
+        size_t step = len - done < SIDECAR_COPY_CHUNK ? len - done : SIDECAR_COPY_CHUNK;
+        memcpy(dst + done, (const char *)src + done, step);
+    }
+    return 0;
+}
+
+int json_sidecar_save(JsonViewer *viewer, const char *sidecar_path) {
+    const JsonSource *source = viewer->source;
+    if (!source || !source->mapped) return -1;
+
+    int count = viewer->token_count;
+    SidecarHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SIDECAR_MAGIC, sizeof(header.magic));
+    header.token_size = sizeof(jsmntok_t);
+    header.token_count = count;
+    describe_source(&header, source);
+    size_t len = layout(&header, count);
+
+    // Written under a temporary name and renamed over the old sidecar, so
+    // a reader never sees half a file
+    size_t path_len = strlen(sidecar_path) + 32;
+    char *tmp_path = malloc(path_len);
+    if (!tmp_path) return -1;
+    snprintf(tmp_path, path_len, "%s.%ld.tmp", sidecar_path, (long)getpid());
+
+    int fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        free(tmp_path);
+        return -1;
+    }
+
+    // Reserve the blocks up front: running out of disk space while writing
+    // through a shared mapping would raise SIGBUS instead of an error
+    void *map = MAP_FAILED;
+    if (posix_fallocate(fd, 0, len) == 0) {
+        map = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) {
+        unlink(tmp_path);
+        free(tmp_path);
+        return -1;
+    }
+
+    char *base = map;
+    const JsonIndex *index = &viewer->index;
+    const void *tables[] = {
+        viewer->tokens, index->parents, index->next, index->nodes
+    };
+    int result = 0;
+
+    for (int i = SECTION_TOKENS; i <= SECTION_NODES && result == 0; i++) {
+        result = copy_section(viewer, base + header.offsets[i], tables[i], section_size(i, count));
+    }
+
+    if (result == 0) {
+        // Lay out the fully expanded document straight into the file
+        VisibleLines lines;
+        lines.count = 0;
+        lines.capacity = count;
+        lines.total = 0;
+        lines.blocks = 0;
+        lines.top_bit = 1;
+        lines.tree = (int *)(base + header.offsets[SECTION_TREE]);
+        lines.shown = (uint64_t *)(base + header.offsets[SECTION_SHOWN]);
+        lines.weights = NULL;
+        lines.borrowed = 1;
+        visible_lines_extend(&lines, index, NULL);
+
+        header.total_lines = lines.total;
+        header.top_bit = lines.top_bit;
+        memcpy(base, &header, sizeof(header));
+    }
+
+    munmap(map, len);
+    if (result == 0 && rename(tmp_path, sidecar_path) == 0) {
+        free(tmp_path);
+        return 0;
+    }
+
+    unlink(tmp_path);
+    free(tmp_path);
+    return -1;
+}
@@ -0,0 +1,34 @@
+#ifndef JSON_SIDECAR_H
+#define JSON_SIDECAR_H
+
+#include "viewer.h"
+
+/* A large file's tokens, structural index and initial line layout, saved
+ * next to it once it has been parsed so that the next open can map them
+ * instead of parsing again. The sidecar is only trusted while the file's
+ * size, mtime and a sampled hash of its contents still match. */
+#define SIDECAR_SUFFIX ".jvidx"
+
+/* Path of the sidecar for a file; the caller frees it. NULL if out of
+ * memory. */
+char *json_sidecar_path(const char *path);
+
+/* Point the viewer's tables into a private mapping of the sidecar of
+ * viewer->source, a mapped file. Pages are only read in as they are
+ * touched, and only copied once they are written to. Returns 0, or -1 if
+ * there is no usable sidecar, leaving the viewer untouched. */
+int json_sidecar_map(JsonViewer *viewer, const char *sidecar_path);
+
+/* Bytes a sidecar takes per token of its document in this build, for the
+ * usage text */
+double json_sidecar_token_bytes(void);
+
+/* Release the mapping; the viewer's tables must not be used afterwards */
+void json_sidecar_unmap(JsonViewer *viewer);
+
+/* Write the sidecar of a fully parsed document, replacing any older one
+ * atomically. Gives up quietly, leaving no file behind, on any error or
+ * once viewer->cancel_load is set. Returns 0 or -1. */
+int json_sidecar_save(JsonViewer *viewer, const char *sidecar_path);
+
+#endif /* JSON_SIDECAR_H */
@@ -0,0 +1,230 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "json_decompress.h"
+#include "json_source.h"
+
+#define READ_CHUNK (1 << 20)
+/* How long a stream may stay quiet before what arrived so far is handed
+ * over, and how often a waiting reader checks for cancellation */
+#define READ_POLL_MS 100
+
+static void close_stream(JsonSource *source) {
+    if (source->decompressor) {
+        json_decompress_stop(source->decompressor);
+        source->decompressor = NULL;
+    }
+    if (source->fd >= 0) {
+        int saved = errno;
+        close(source->fd);
+        errno = saved;
+        source->fd = -1;
+    }
+}
+
+int json_source_reserve(JsonSource *source, size_t want) {
+    if (source->capacity - source->len >= want) return 0;
+
+    size_t capacity = source->capacity ? source->capacity : READ_CHUNK;
+    while (capacity - source->len < want) {
+        capacity *= 2;
+    }
+
+    char *grown = realloc((void *)source->data, capacity);
+    if (!grown) {
+        errno = ENOMEM;
+        return -1;
+    }
+    source->data = grown;
+    source->capacity = capacity;
+    return 0;
+}
+
+ssize_t json_source_read_fd(int fd, void *buf, size_t room, int pending, const int *cancel) {
+    for (;;) {
+        struct pollfd pfd = { fd, POLLIN, 0 };
+        int ready = poll(&pfd, 1, READ_POLL_MS);
+        if (ready < 0 && errno != EINTR) return -1;
+        if (ready <= 0) {
+            if (pending || (cancel && __atomic_load_n(cancel, __ATOMIC_RELAXED))) {
+                return JSON_READ_PAUSED;
+            }
+            continue;
+        }
+
+        ssize_t n = read(fd, buf, room);
+        if (n < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+        return n;
+    }
+}
+
+/* Check the first bytes of a stream, and hand a compressed one over to a
+ * decompressor along with what was read of it. Returns 0, or -1 with
+ * errno set. */
+static int detect_compression(JsonSource *source, const int *cancel) {
+    char *buf = (char *)source->data;
+
+    // Only the magic is read here, since a decompressor takes no more
+    while (source->len < JSON_COMPRESSION_MAGIC_LEN) {
+        ssize_t n = json_source_read_fd(source->fd, buf + source->len,
+                                        JSON_COMPRESSION_MAGIC_LEN - source->len, 0, cancel);
+        if (n == JSON_READ_PAUSED) return 0;
+        if (n < 0) return -1;
+        if (n == 0) break;
+        source->len += n;
+    }
+    source->detected = 1;
+
+    JsonCompression format = json_compression_detect(buf, source->len);
+    if (format == JSON_COMPRESSION_NONE) return 0;
+    if (!json_compression_supported(format)) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    source->decompressor = json_decompress_start(source->fd, format, buf, source->len);
+    if (!source->decompressor) return -1;
+    source->len = 0;
+    return 0;
+}
+
+ssize_t json_source_read(JsonSource *source, size_t want, const int *cancel) {
+    char *buf = (char *)source->data;
+    size_t start = source->len;
+
+    if (source->fd >= 0 && !source->detected) {
+        if (detect_compression(source, cancel) < 0) {
+            close_stream(source);
+            return -1;
+        }
+        // Compressed bytes read for the check are not part of the text
+        if (source->len < start) start = source->len;
+    }
+    size_t got = source->len - start;
+
+    while (source->fd >= 0 && source->detected && got < want && source->len < source->capacity) {
+        size_t room = source->capacity - source->len;
+        ssize_t n = source->decompressor
+            ? json_decompress_read(source->decompressor, buf + source->len, room, got > 0, cancel)
+            : json_source_read_fd(source->fd, buf + source->len, room, got > 0, cancel);
+        if (n == JSON_READ_PAUSED) break;
+        if (n < 0) {
+            close_stream(source);
+            return -1;
+        }
+        if (n == 0) {
+            close_stream(source);
+            break;
+        }
+        source->len += n;
+        got += n;
+    }
+
+    return got;
+}
+
+/* Read a stream that cannot be mapped to the end */
+static int read_stream(JsonSource *source) {
+    while (source->fd >= 0) {
+        if (json_source_reserve(source, READ_CHUNK) < 0 ||
+            json_source_read(source, READ_CHUNK, NULL) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Open a file, mapping it when possible */
+int json_source_open(JsonSource *source, const char *path) {
+    source->data = NULL;
+    source->len = 0;
+    source->capacity = 0;
+    source->mapped = 0;
+    source->fd = -1;
+    source->detected = 0;
+    source->decompressor = NULL;
+    source->mtime.tv_sec = 0;
+    source->mtime.tv_nsec = 0;
+
+    // Standard input is duplicated so that the terminal can take its place
+    int fd = strcmp(path, JSON_SOURCE_STDIN) == 0 ? dup(STDIN_FILENO) : open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+
+    // A compressed file is decompressed a chunk at a time, like a pipe.
+    // Regular files are checked up front, so that a format this build
+    // cannot read is reported right away.
+    JsonCompression format = JSON_COMPRESSION_NONE;
+    if (S_ISREG(st.st_mode)) {
+        char magic[JSON_COMPRESSION_MAGIC_LEN];
+        ssize_t n = pread(fd, magic, sizeof(magic), 0);
+        format = json_compression_detect(magic, n > 0 ? n : 0);
+        if (format != JSON_COMPRESSION_NONE && !json_compression_supported(format)) {
+            close(fd);
+            errno = ENOTSUP;
+            return -1;
+        }
+    }
+
+    if (!S_ISREG(st.st_mode) || format != JSON_COMPRESSION_NONE) {
+        source->fd = fd;
+        if (json_source_reserve(source, READ_CHUNK) < 0) {
+            close_stream(source);
+            return -1;
+        }
+        return 0;
+    }
+
+    int result = 0;
+    void *map = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    if (map != MAP_FAILED) {
+        source->data = map;
+        source->len = st.st_size;
+        source->mapped = 1;
+        source->mtime = st.st_mtim;
+        close(fd);
+    } else {
+        source->fd = fd;
+        result = read_stream(source);
+        close_stream(source);
+    }
+
+    if (result < 0) {
+        int saved = errno;
+        json_source_close(source);
+        errno = saved;
+    }
+    return result;
+}
+
+void json_source_advise(JsonSource *source, int sequential) {
+    if (!source->mapped) return;
+    madvise((void *)source->data, source->len, sequential ? MADV_SEQUENTIAL : MADV_NORMAL);
+}
+
+void json_source_close(JsonSource *source) {
+    close_stream(source);
+    if (source->mapped) {
+        munmap((void *)source->data, source->len);
+    } else {
+        free((void *)source->data);
+    }
+    source->data = NULL;
+    source->len = 0;
+    source->capacity = 0;
+    source->mapped = 0;
+}
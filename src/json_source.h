@@ -0,0 +1,60 @@
+#ifndef JSON_SOURCE_H
+#define JSON_SOURCE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <time.h>
+
+/* Path that stands for standard input */
+#define JSON_SOURCE_STDIN "-"
+
+struct JsonDecompressor;
+
+/* Raw JSON text as loaded from disk. Regular files are memory-mapped and
+ * tokens point straight into the mapping; anything that cannot be mapped
+ * (pipes, character devices, standard input) is read into a growing heap
+ * buffer, a chunk at a time while it is being viewed. So is compressed
+ * input, which is decompressed straight into that buffer. The text is not
+ * NUL-terminated. */
+typedef struct {
+    const char *data;
+    size_t len;
+    size_t capacity;    /* of the heap buffer */
+    int mapped;     /* 1 if data is an mmap of the file, 0 if heap */
+    int fd;         /* stream still being read, or -1 once it has ended */
+    int detected;   /* 1 once the stream was checked for compression */
+    struct JsonDecompressor *decompressor;  /* NULL unless compressed */
+    struct timespec mtime;  /* of the file when it was mapped */
+} JsonSource;
+
+/* Open a file, or standard input for "-". Regular files are loaded right
+ * away; streams are left open for json_source_read. Returns 0, or -1 with
+ * errno set. */
+int json_source_open(JsonSource *source, const char *path);
+
+/* Make room for at least want more bytes of a stream. This may move data,
+ * so nobody may be reading it meanwhile. Returns 0, or -1 if out of
+ * memory. */
+int json_source_reserve(JsonSource *source, size_t want);
+
+/* Read a stream into the room made by json_source_reserve until want more
+ * bytes have arrived, or the writer has paused with something read. Only
+ * bytes past len are written, so data may be read concurrently. The
+ * stream is closed once it ends or fails. Gives up early, returning 0,
+ * when *cancel becomes nonzero. Returns the number of bytes read, or -1
+ * with errno set. */
+ssize_t json_source_read(JsonSource *source, size_t want, const int *cancel);
+
+/* Wait for the next bytes of a file descriptor and read them. Waiting
+ * stops, returning JSON_READ_PAUSED, if pending is set and the writer
+ * paused, or if *cancel becomes nonzero. Returns the byte count, 0 at the
+ * end, or -1 with errno set. */
+ssize_t json_source_read_fd(int fd, void *buf, size_t room, int pending, const int *cancel);
+
+/* Hint the kernel about the coming access pattern: aggressive read-ahead
+ * while the tokenizer streams through the text, default paging afterwards */
+void json_source_advise(JsonSource *source, int sequential);
+
+void json_source_close(JsonSource *source);
+
+#endif /* JSON_SOURCE_H */
@@ -1,264 +1,233 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
 #include <ncurses.h>
 
-#include "jsmn.h"
+#include "batch.h"
+#include "bitset.h"
+#include "format.h"
+#include "json_sidecar.h"
+#include "ndjson.h"
+#include "search.h"
+#include "stats.h"
+#include "viewer.h"
 
-#define FREE_PTR( x ) { free(x); x=0; }
+#define WIDE_BUILD_SUFFIX "_wide"
+#define LOAD_REFRESH_MS 100
 
-/* strdup implementation for C99 compatibility */
-char* my_strdup(const char *s) {
-    size_t len = strlen(s) + 1;
-    char *d = malloc(len);
-    if (d) memcpy(d, s, len);
-    return d;
+/* Find the token index for a given visible line */
+int get_token_for_line(JsonViewer *viewer, int line) {
+    return visible_lines_token(&viewer->lines, line);
 }
 
-#define MAX_TOKENS 2048
-#define INDENT_SIZE 4
-#define MAX_SEARCH_LEN 256
+/* Content rows start below the header and leave room for the status line */
+#define CONTENT_START 3
+#define ROW_TEXT_MAX 512
 
+/* What a content row showed when it was last drawn. A row is only
+ * formatted again when it shows another line or its document changed,
+ * and only drawn again when its text or highlight differ. */
 typedef struct {
-    jsmntok_t *tokens;
-    int token_count;
-    char *json_str;
-    int current_line;
-    int scroll_offset;
-    int *visible_tokens;
-    int visible_count;
-    int *collapsed;
-    int *depths;
+    const JsonViewer *doc;  /* document of the line, NULL for a blank row */
+    int tok;                /* token shown, or -1 for a record's raw text */
+    int record;             /* JSON Lines record, or -1 */
+    unsigned int revision;  /* of doc when the text was formatted */
+    attr_t attr;
+    int x;
+    char text[ROW_TEXT_MAX];
+} ScreenRow;
+
+/* The terminal as left by the last frame */
+typedef struct {
+    ScreenRow *rows;
+    int count;
     int max_y, max_x;
-    char search_term[MAX_SEARCH_LEN];
-    int *search_matches;
-    int search_match_count;
-    int current_match_idx;
-    int search_mode;
-} JsonViewer;
-
-/* Case-insensitive substring search */
-char* stristr(const char *haystack, const char *needle) {
-    if (!*needle) return (char*)haystack;
-
-    for (; *haystack; haystack++) {
-        const char *h = haystack;
-        const char *n = needle;
-
-        while (*h && *n && tolower((unsigned char)*h) == tolower((unsigned char)*n)) {
-            h++;
-            n++;
-        }
-
-        if (!*n) return (char*)haystack;
-    }
-
-    return NULL;
-}
+    int scroll_offset;      /* line shown on the first row */
+} Screen;
 
-/* Skip to next sibling token */
-int skip_token(jsmntok_t *tokens, int token_idx, int count) {
-    jsmntok_t *tok = &tokens[token_idx];
-    int next = token_idx + 1;
+static Screen screen;
 
-    if (tok->type == JSMN_OBJECT || tok->type == JSMN_ARRAY) {
-        int children = tok->size;
-        if (tok->type == JSMN_OBJECT) {
-            children *= 2; // Objects have key-value pairs
-        }
+/* Whether the stats overlay is up, toggled with S */
+static int show_stats;
 
-        for (int i = 0; i < children && next < count; i++) {
-            next = skip_token(tokens, next, count);
-        }
-    }
-
-    return next;
+static void blank_row(ScreenRow *row) {
+    row->doc = NULL;
+    row->tok = -1;
+    row->record = -1;
+    row->attr = 0;
+    row->x = 0;
+    row->text[0] = '\0';
 }
 
-/* Calculate token depths for indentation */
-void calculate_depths(jsmntok_t *tokens, int count, int *depths) {
-    depths[0] = 0;
-
-    for (int i = 1; i < count; i++) {
-        int depth = 0;
-        int pos = tokens[i].start;
-
-        for (int j = 0; j < i; j++) {
-            if (tokens[j].start < pos && tokens[j].end > pos) {
-                depth++;
-            }
-        }
-        depths[i] = depth;
+/* Start over from a blank terminal of a new size, header included */
+static int screen_reset(JsonViewer *viewer, int rows) {
+    ScreenRow *grown = realloc(screen.rows, sizeof(ScreenRow) * (rows > 0 ? rows : 1));
+    if (!grown) return -1;
+
+    screen.rows = grown;
+    screen.count = rows;
+    screen.max_y = viewer->max_y;
+    screen.max_x = viewer->max_x;
+    screen.scroll_offset = viewer->scroll_offset;
+    for (int i = 0; i < rows; i++) {
+        blank_row(&screen.rows[i]);
     }
-}
 
-/* Check if token is a key in an object */
-int is_object_key(JsonViewer *viewer, int tok_idx) {
-    if (tok_idx == 0) return 0;
-
-    int pos = viewer->tokens[tok_idx].start;
-    for (int i = tok_idx - 1; i >= 0; i--) {
-        jsmntok_t *parent = &viewer->tokens[i];
-        if (parent->start < pos && parent->end > pos) {
-            if (parent->type == JSMN_OBJECT) {
-                int child_idx = i + 1;
-                int count = 0;
-                while (child_idx < tok_idx) {
-                    count++;
-                    child_idx = skip_token(viewer->tokens, child_idx, viewer->token_count);
-                }
-                return (count % 2 == 0);
-            }
-            break;
-        }
+    erase();
+    attron(A_REVERSE);
+    mvprintw(0, 0, " JSON Viewer - by Cristian Mancus ");
+    for (int i = 35; i < viewer->max_x; i++) {
+        addch(' ');
     }
-    return 0;
-}
+    attroff(A_REVERSE);
 
-/* Find the token index for a given visible line */
-int get_token_for_line(JsonViewer *viewer, int line) {
-    if (line < 0 || line >= viewer->visible_count) return -1;
-    return viewer->visible_tokens[line];
+    mvprintw(1, 0, " j/k: down/up | h/l: collapse/expand | /: search | n/N: next/prev | q: quit");
+    return 0;
 }
 
-/* Check if token content matches search term */
-int token_matches_search(JsonViewer *viewer, int tok_idx) {
-    if (!viewer->search_term[0]) return 0;
-
-    jsmntok_t *tok = &viewer->tokens[tok_idx];
+/* Move the rows already on the terminal by shift lines, so that scrolling
+ * by a few lines only draws the rows coming into view. With idlok set the
+ * terminal scrolls its own region instead of being sent every row. */
+static void screen_scroll(int shift) {
+    int count = screen.count;
 
-    // Don't match on object/array containers themselves
-    if (tok->type == JSMN_OBJECT || tok->type == JSMN_ARRAY) {
-        return 0;
+    if (shift >= count || -shift >= count) {
+        for (int i = 0; i < count; i++) {
+            blank_row(&screen.rows[i]);
+        }
+        return;
     }
 
-    int len = tok->end - tok->start;
-
-    if (len <= 0) return 0;
-
-    char *token_str = malloc(len + 1);
-    if (!token_str) return 0;
-
-    memcpy(token_str, viewer->json_str + tok->start, len);
-    token_str[len] = '\0';
-
-    int matches = (stristr(token_str, viewer->search_term) != NULL);
+    setscrreg(CONTENT_START, CONTENT_START + count - 1);
+    scrollok(stdscr, TRUE);
+    scrl(shift);
+    scrollok(stdscr, FALSE);
+    setscrreg(0, screen.max_y - 1);
 
-    FREE_PTR(token_str);
-    return matches;
-}
-
-/* Build search matches list */
-void build_search_matches(JsonViewer *viewer) {
-    viewer->search_match_count = 0;
-
-    if (!viewer->search_term[0]) return;
-
-    for (int i = 0; i < viewer->visible_count; i++) {
-        int tok_idx = viewer->visible_tokens[i];
-        if (token_matches_search(viewer, tok_idx)) {
-            viewer->search_matches[viewer->search_match_count++] = i;
+    if (shift > 0) {
+        memmove(&screen.rows[0], &screen.rows[shift], sizeof(ScreenRow) * (count - shift));
+        for (int i = count - shift; i < count; i++) {
+            blank_row(&screen.rows[i]);
+        }
+    } else {
+        memmove(&screen.rows[-shift], &screen.rows[0], sizeof(ScreenRow) * (count + shift));
+        for (int i = 0; i < -shift; i++) {
+            blank_row(&screen.rows[i]);
         }
     }
 }
 
-/* Go to next search match */
-void goto_next_match(JsonViewer *viewer) {
-    if (viewer->search_match_count == 0) return;
-
-    viewer->current_match_idx = (viewer->current_match_idx + 1) % viewer->search_match_count;
-    viewer->current_line = viewer->search_matches[viewer->current_match_idx];
-}
-
-/* Go to previous search match */
-void goto_prev_match(JsonViewer *viewer) {
-    if (viewer->search_match_count == 0) return;
+/* Bring one content row up to date with the line it now shows */
+static void draw_row(JsonViewer *viewer, int i) {
+    ScreenRow *row = &screen.rows[i];
+    int line_idx = viewer->scroll_offset + i;
+    JsonViewer *doc = NULL;
+    int tok_idx = -1;
+    int record = -1;
+    attr_t attr = 0;
+
+    if (line_idx < viewer->lines.total) {
+        // In JSON Lines mode a line shows a token of one record's own
+        // document, or a record that is not expanded
+        doc = viewer;
+        if (viewer->ndjson) {
+            record = ndjson_line(viewer, line_idx, &doc, &tok_idx);
+            if (tok_idx < 0) doc = viewer;
+        } else {
+            tok_idx = visible_lines_token(&viewer->lines, line_idx);
+        }
 
-    viewer->current_match_idx--;
-    if (viewer->current_match_idx < 0) {
-        viewer->current_match_idx = viewer->search_match_count - 1;
-    }
-    viewer->current_line = viewer->search_matches[viewer->current_match_idx];
-}
+        // A key's line also shows a match in the value drawn next to it
+        int is_search_match = 0;
+        if (viewer->search_term[0] && tok_idx < 0) {
+            is_search_match = bitset_test(viewer->search_matches, record);
+        } else if (viewer->search_term[0]) {
+            is_search_match = bitset_test(doc->search_matches, tok_idx) ||
+                (tok_idx + 1 < doc->token_count && is_inline_value(&doc->index, tok_idx + 1) &&
+                 bitset_test(doc->search_matches, tok_idx + 1));
+        }
 
-/* Build list of visible tokens (expanded tree view) */
-void build_visible_tokens(JsonViewer *viewer, int token_idx, int depth) {
-    if (token_idx >= viewer->token_count || viewer->visible_count >= MAX_TOKENS) {
-        return;
+        // Highlight current line or search match
+        if (line_idx == viewer->current_line) {
+            attr = A_REVERSE;
+        } else if (is_search_match) {
+            attr = A_BOLD;
+        }
     }
 
-    jsmntok_t *tok = &viewer->tokens[token_idx];
+    int same_line = row->doc == doc && row->tok == tok_idx && row->record == record &&
+                    (!doc || row->revision == doc->revision);
+    if (same_line && row->attr == attr) return;
+
+    if (!same_line) {
+        char text[ROW_TEXT_MAX];
+        int x = 0;
+
+        text[0] = '\0';
+        if (doc && tok_idx < 0) {
+            format_record(viewer, record, text, sizeof(text));
+        } else if (doc) {
+            x = token_depth(&doc->index, tok_idx) * INDENT_SIZE;
+            if (record >= 0) {
+                format_record_line(viewer, record, doc, tok_idx, text, sizeof(text));
+            } else {
+                format_line(doc, tok_idx, text, sizeof(text));
+            }
+        }
 
-    // Add current token to visible list
-    viewer->visible_tokens[viewer->visible_count++] = token_idx;
+        row->doc = doc;
+        row->tok = tok_idx;
+        row->record = record;
+        row->revision = doc ? doc->revision : 0;
 
-    // Don't expand if collapsed
-    if (viewer->collapsed[token_idx]) {
-        return;
+        // A line formatted again often reads just the same
+        if (row->attr == attr && row->x == x && strcmp(row->text, text) == 0) return;
+        row->x = x;
+        strcpy(row->text, text);
     }
+    row->attr = attr;
 
-    // Process children
-    if (tok->type == JSMN_OBJECT) {
-        int child_idx = token_idx + 1;
-        for (int i = 0; i < tok->size && child_idx < viewer->token_count; i++) {
-            // Key
-            int key_idx = child_idx; (void)key_idx;
-            build_visible_tokens(viewer, child_idx, depth + 1);
-            child_idx = skip_token(viewer->tokens, child_idx, viewer->token_count);
-
-            // Value - check if it's a primitive/string that will be shown inline
-            jsmntok_t *value_tok = &viewer->tokens[child_idx];
-            if (value_tok->type == JSMN_STRING || value_tok->type == JSMN_PRIMITIVE) {
-                // Skip adding the value token since it will be displayed inline with key
-                // But we still need to mark it as processed
-            } else {
-                // Object or array - add it separately
-                build_visible_tokens(viewer, child_idx, depth + 1);
-            }
-            child_idx = skip_token(viewer->tokens, child_idx, viewer->token_count);
-        }
-    } else if (tok->type == JSMN_ARRAY) {
-        int child_idx = token_idx + 1;
-        for (int i = 0; i < tok->size && child_idx < viewer->token_count; i++) {
-            build_visible_tokens(viewer, child_idx, depth + 1);
-            child_idx = skip_token(viewer->tokens, child_idx, viewer->token_count);
-        }
+    int y = CONTENT_START + i;
+    move(y, 0);
+    clrtoeol();
+    if (row->text[0] && row->x < screen.max_x) {
+        attron(attr);
+        mvaddnstr(y, row->x, row->text, screen.max_x - row->x);
+        attroff(attr);
     }
 }
 
-/* Print token value to a string buffer */
-void format_token_value(const char *json, jsmntok_t *tok, char *buf, int bufsize) {
-    int len = tok->end - tok->start;
-    if (len >= bufsize) len = bufsize - 1;
+/* The stats report in the top right corner of the content rows */
+static void draw_stats(JsonViewer *viewer) {
+    char lines[STATS_MAX_LINES][STATS_LINE_MAX];
+    int count = stats_report(viewer, lines, STATS_MAX_LINES);
+    int width = 0;
 
-    if (tok->type == JSMN_STRING) {
-        snprintf(buf, bufsize, "\"%.*s\"", len, json + tok->start);
-    } else {
-        snprintf(buf, bufsize, "%.*s", len, json + tok->start);
+    for (int i = 0; i < count; i++) {
+        int len = strlen(lines[i]);
+        if (len > width) width = len;
+    }
+    int x = viewer->max_x - width - 2;
+    if (x < 0) x = 0;
+
+    attron(COLOR_PAIR(1));
+    for (int i = 0; i < count && CONTENT_START + i < viewer->max_y - 2; i++) {
+        mvprintw(CONTENT_START + i, x, " %-*s ", width, lines[i]);
     }
+    attroff(COLOR_PAIR(1));
 }
 
-/* Display the JSON tree using ncurses */
+/* Display the JSON tree using ncurses. Only what changed since the last
+ * frame is drawn, and ncurses sends the terminal only the cells that
+ * differ from what it already shows. */
 void display_json(JsonViewer *viewer) {
+    long long start = stats_now();
     getmaxyx(stdscr, viewer->max_y, viewer->max_x);
 
-    // Clear and redraw
-    erase();
-
-    // Header
-    attron(A_REVERSE);
-    mvprintw(0, 0, " JSON Viewer - by Cristian Mancus ");
-    for (int i = 35; i < viewer->max_x; i++) {
-        addch(' ');
-    }
-    attroff(A_REVERSE);
-
-    mvprintw(1, 0, " j/k: down/up | h/l: collapse/expand | /: search | n/N: next/prev | q: quit");
-
-    // Content area starts at line 3
-    int content_start = 3;
-    int max_lines = viewer->max_y - content_start - 2; // Leave room for status line
+    int max_lines = viewer->max_y - CONTENT_START - 2; // Leave room for status line
+    if (max_lines < 0) max_lines = 0;
 
     // Adjust scroll to keep current line visible
     if (viewer->current_line < viewer->scroll_offset) {
@@ -268,112 +237,75 @@ void display_json(JsonViewer *viewer) {
         viewer->scroll_offset = viewer->current_line - max_lines + 1;
     }
 
-    // Display visible lines
-    for (int i = 0; i < max_lines && (viewer->scroll_offset + i) < viewer->visible_count; i++) {
-        int line_idx = viewer->scroll_offset + i;
-        int tok_idx = viewer->visible_tokens[line_idx];
-        jsmntok_t *tok = &viewer->tokens[tok_idx];
-        int depth = viewer->depths[tok_idx];
-
-        int y_pos = content_start + i;
-
-        // Check if this line is a search match
-        int is_search_match = 0;
-        if (viewer->search_term[0]) {
-            for (int j = 0; j < viewer->search_match_count; j++) {
-                if (viewer->search_matches[j] == line_idx) {
-                    is_search_match = 1;
-                    break;
-                }
-            }
-        }
-
-        // Highlight current line or search match
-        if (line_idx == viewer->current_line) {
-            attron(A_REVERSE);
-        } else if (is_search_match) {
-            attron(A_BOLD);
-        }
-
-        // Move to position and clear line
-        move(y_pos, 0);
-        clrtoeol();
-
-        // Indentation
-        int x_pos = depth * INDENT_SIZE;
-        move(y_pos, x_pos);
-
-        // Check if this is a key and next token is its value
-        int is_key = is_object_key(viewer, tok_idx);
-        int next_line_idx = line_idx + 1; (void)next_line_idx;
-
-        char value_buf[256];
-
-        if (is_key) {
-            // Display key
-            format_token_value(viewer->json_str, tok, value_buf, sizeof(value_buf));
-            printw("%s : ", value_buf);
-
-            // Find the actual value token (not from visible list, but from token array)
-            int value_tok_idx = skip_token(viewer->tokens, tok_idx, viewer->token_count);
-            if (value_tok_idx < viewer->token_count) {
-                jsmntok_t *value_tok = &viewer->tokens[value_tok_idx];
-
-                if (value_tok->type == JSMN_STRING || value_tok->type == JSMN_PRIMITIVE) {
-                    // Show value inline
-                    format_token_value(viewer->json_str, value_tok, value_buf, sizeof(value_buf));
-                    printw("%s", value_buf);
-                } else if (value_tok->type == JSMN_OBJECT) {
-                    // printw("%s{ } (%d items)%s",
-                    printw("%s{%d items}%s",
-                           viewer->collapsed[value_tok_idx] ? "[+] " : "[-] ",
-                           value_tok->size,
-                           viewer->collapsed[value_tok_idx] ? " ..." : "");
-                } else if (value_tok->type == JSMN_ARRAY) {
-                    // printw("%s[ ] (%d items)%s",
-                    printw("%s[%d items]%s",
-                           viewer->collapsed[value_tok_idx] ? "[+] " : "[-] ",
-                           value_tok->size,
-                           viewer->collapsed[value_tok_idx] ? " ..." : "");
-                }
-            }
-        } else if (tok->type == JSMN_OBJECT) {
-            // printw("%s{ } (%d items)%s",
-            printw("%s{%d items}%s",
-                   viewer->collapsed[tok_idx] ? "[+] " : "[-] ",
-                   tok->size,
-                   viewer->collapsed[tok_idx] ? " ..." : "");
-        } else if (tok->type == JSMN_ARRAY) {
-            // printw("%s[ ] (%d items)%s",
-            printw("%s[%d items]%s",
-                   viewer->collapsed[tok_idx] ? "[+] " : "[-] ",
-                   tok->size,
-                   viewer->collapsed[tok_idx] ? " ..." : "");
-        } else {
-            // Standalone primitive/string (array element)
-            format_token_value(viewer->json_str, tok, value_buf, sizeof(value_buf));
-            printw("%s", value_buf);
-        }
+    // Rows under the overlay cannot be scrolled or kept, so while it is up
+    // every frame starts from a blank screen
+    if (!screen.rows || show_stats || viewer->max_y != screen.max_y || viewer->max_x != screen.max_x) {
+        if (screen_reset(viewer, max_lines) < 0) return;
+    } else if (viewer->scroll_offset != screen.scroll_offset) {
+        screen_scroll(viewer->scroll_offset - screen.scroll_offset);
+        screen.scroll_offset = viewer->scroll_offset;
+    }
 
-        if (line_idx == viewer->current_line) {
-            attroff(A_REVERSE);
-        } else if (is_search_match) {
-            attroff(A_BOLD);
-        }
+    for (int i = 0; i < screen.count; i++) {
+        draw_row(viewer, i);
+    }
+    if (show_stats) {
+        draw_stats(viewer);
     }
 
     // Status line
     attron(COLOR_PAIR(1));
-    if (viewer->search_term[0]) {
+    if (viewer->loading && viewer->input_open) {
+        // A stream's length is not known until it ends
+        mvprintw(viewer->max_y - 1, 0, " Line %d/%d | Loading %zu KB | %s: %d ",
+                 viewer->current_line + 1, viewer->lines.total,
+                 viewer->json_len >> 10,
+                 viewer->ndjson ? "Records" : "Tokens",
+                 viewer->ndjson ? viewer->ndjson->count : viewer->token_count);
+    } else if (viewer->loading) {
+        mvprintw(viewer->max_y - 1, 0, " Line %d/%d | Loading %d%% | %s: %d ",
+                 viewer->current_line + 1, viewer->lines.total,
+                 (int)(viewer->parsed_len * 100 / (viewer->json_len ? viewer->json_len : 1)),
+                 viewer->ndjson ? "Records" : "Tokens",
+                 viewer->ndjson ? viewer->ndjson->count : viewer->token_count);
+    } else if (viewer->load_error == JSON_ERROR_READ) {
+        mvprintw(viewer->max_y - 1, 0, " Line %d/%d | Failed to read input: %s after %zu bytes ",
+                 viewer->current_line + 1, viewer->lines.total,
+                 strerror(viewer->read_errno), viewer->json_len);
+    } else if (viewer->load_error == JSON_ERROR_TOO_LARGE) {
+        mvprintw(viewer->max_y - 1, 0, " Line %d/%d | Input is larger than 2 GiB: "
+                 "run jsonViewer_wide (make wide) to see all of it ",
+                 viewer->current_line + 1, viewer->lines.total);
+    } else if (viewer->load_error) {
+        mvprintw(viewer->max_y - 1, 0, " Line %d/%d | Failed to parse JSON: %d after %zu bytes | Tokens: %d ",
+                 viewer->current_line + 1, viewer->lines.total,
+                 viewer->load_error, viewer->parsed_len,
+                 viewer->token_count);
+    } else if (viewer->search) {
+        mvprintw(viewer->max_y - 1, 0, " Line %d/%d | Searching \"%s\"... %d matches so far ",
+                 viewer->current_line + 1, viewer->lines.total,
+                 viewer->search_term,
+                 viewer->search_match_count);
+    } else if (viewer->search_error) {
+        mvprintw(viewer->max_y - 1, 0, " Line %d/%d | Search: \"%s\" (%s) ",
+                 viewer->current_line + 1, viewer->lines.total,
+                 viewer->search_term, viewer->search_error);
+    } else if (viewer->search_term[0]) {
         mvprintw(viewer->max_y - 1, 0, " Line %d/%d | Search: \"%s\" (%d matches) | Match %d/%d ",
-                 viewer->current_line + 1, viewer->visible_count,
+                 viewer->current_line + 1, viewer->lines.total,
                  viewer->search_term,
                  viewer->search_match_count,
                  viewer->search_match_count > 0 ? viewer->current_match_idx + 1 : 0,
                  viewer->search_match_count);
+    } else if (viewer->ndjson) {
+        mvprintw(viewer->max_y - 1, 0, " Line %d/%d | Record %d/%d | Size: %dx%d ",
+                 viewer->current_line + 1, viewer->lines.total,
+                 visible_lines_token(&viewer->lines, viewer->current_line) + 1,
+                 viewer->ndjson->count,
+                 viewer->max_y, viewer->max_x);
     } else {
         mvprintw(viewer->max_y - 1, 0, " Line %d/%d | Tokens: %d | Size: %dx%d ",
-                 viewer->current_line + 1, viewer->visible_count,
+                 viewer->current_line + 1, viewer->lines.total,
                  viewer->token_count,
                  viewer->max_y, viewer->max_x);
     }
@@ -381,136 +313,264 @@ void display_json(JsonViewer *viewer) {
     attroff(COLOR_PAIR(1));
 
     refresh();
+    stats_add(STATS_RENDER, start);
+}
+
+/* The collapsed containers of one document when a search began */
+typedef struct {
+    int record;             /* JSON Lines record, or -1 for the whole document */
+    uint64_t *collapsed;
+    int count;              /* tokens covered */
+} SavedFolds;
+
+/* Where the cursor was and what was collapsed before a search term was
+ * typed. Every keystroke reveals the first match of the term so far, so
+ * cancelling the search takes back whatever that opened. */
+typedef struct {
+    int line;
+    int record;             /* JSON Lines record on the cursor line, or -1 */
+    int tok;                /* token on the cursor line, or -1 */
+    SavedFolds *docs;       /* sorted by record */
+    int doc_count;
+} SearchOrigin;
+
+static void save_folds(SavedFolds *saved, const JsonViewer *doc, int record) {
+    size_t bytes = sizeof(uint64_t) * BITSET_WORDS(doc->token_count);
+
+    saved->record = record;
+    saved->count = doc->token_count;
+    saved->collapsed = malloc(bytes ? bytes : 1);
+    if (saved->collapsed) {
+        memcpy(saved->collapsed, doc->collapsed, bytes);
+    } else {
+        saved->count = 0;
+    }
+}
+
+/* Collapse again what was collapsed when the folds were saved. Returns 1
+ * if the layout changed. */
+static int restore_folds(JsonViewer *doc, const SavedFolds *saved) {
+    int changed = 0;
+
+    for (int w = 0; w < (int)BITSET_WORDS(saved->count); w++) {
+        uint64_t reopened = saved->collapsed[w] & ~doc->collapsed[w];
+        while (reopened) {
+            changed |= set_collapsed(doc, (w << 6) + __builtin_ctzll(reopened), 1);
+            reopened &= reopened - 1;
+        }
+    }
+    return changed;
+}
+
+static void search_origin_save(JsonViewer *viewer, SearchOrigin *origin) {
+    origin->line = viewer->current_line;
+    origin->doc_count = 0;
+
+    if (!viewer->ndjson) {
+        origin->record = -1;
+        origin->tok = get_token_for_line(viewer, viewer->current_line);
+        origin->docs = malloc(sizeof(SavedFolds));
+        if (origin->docs) save_folds(&origin->docs[origin->doc_count++], viewer, -1);
+        return;
+    }
+
+    JsonViewer *doc;
+    origin->record = ndjson_line(viewer, viewer->current_line, &doc, &origin->tok);
+    origin->docs = malloc(sizeof(SavedFolds) * (viewer->ndjson->parsed_count + 1));
+    if (!origin->docs) return;
+    for (int i = 0; i < viewer->ndjson->parsed_count; i++) {
+        const NdjsonRecord *parsed = &viewer->ndjson->parsed[i];
+        if (parsed->doc) save_folds(&origin->docs[origin->doc_count++], parsed->doc, parsed->record);
+    }
+}
+
+/* Put the folds and the cursor back the way they were */
+static void search_origin_restore(JsonViewer *viewer, const SearchOrigin *origin) {
+    if (!viewer->ndjson) {
+        if (origin->doc_count > 0) restore_folds(viewer, &origin->docs[0]);
+        viewer->current_line = origin->tok >= 0 ? visible_lines_line(&viewer->lines, origin->tok)
+                                                : origin->line;
+        return;
+    }
+
+    // Records parsed since started out with only their root collapsed
+    int k = 0;
+    for (int i = 0; i < viewer->ndjson->parsed_count; i++) {
+        JsonViewer *doc = viewer->ndjson->parsed[i].doc;
+        int record = viewer->ndjson->parsed[i].record;
+        while (k < origin->doc_count && origin->docs[k].record < record) k++;
+        if (!doc) continue;
+
+        int changed = k < origin->doc_count && origin->docs[k].record == record
+                          ? restore_folds(doc, &origin->docs[k])
+                          : set_collapsed(doc, 0, 1);
+        if (changed) ndjson_relayout(viewer, record);
+    }
+
+    if (origin->record < 0) {
+        viewer->current_line = origin->line;
+        return;
+    }
+    viewer->current_line = ndjson_record_line(viewer, origin->record);
+    JsonViewer *doc = ndjson_parsed(viewer, origin->record, NULL);
+    if (origin->tok >= 0 && doc && !bitset_test(doc->collapsed, 0)) {
+        viewer->current_line += visible_lines_line(&doc->lines, origin->tok);
+    }
+}
+
+static void search_origin_free(SearchOrigin *origin) {
+    for (int i = 0; i < origin->doc_count; i++) {
+        free(origin->docs[i].collapsed);
+    }
+    free(origin->docs);
 }
 
-/* Search input mode */
+/* Search input mode. The search reruns on every keystroke, narrowing down
+ * the results cached for the shorter terms typed before. */
 void search_input(JsonViewer *viewer) {
     int ch;
     int cursor_pos = strlen(viewer->search_term);
+    SearchOrigin origin;
+    SearchCache cache;
+
+    search_cache_init(&cache);
+    search_origin_save(viewer, &origin);
 
     // Enable echo and cursor for input
     echo();
     curs_set(1);
 
     while (1) {
+        // Show where the current term leads while it is being typed
+        search_poll(viewer);
+        display_json(viewer);
+
         // Display search prompt
         attron(COLOR_PAIR(1));
         mvprintw(viewer->max_y - 1, 0, " Search: %s", viewer->search_term);
+        if (viewer->search_error) {
+            printw("  (%s)", viewer->search_error);
+        } else if (viewer->search_term[0]) {
+            printw("  (%d matches%s)", viewer->search_match_count, viewer->search ? "..." : "");
+        }
         clrtoeol();
         attroff(COLOR_PAIR(1));
         move(viewer->max_y - 1, 9 + cursor_pos);
         refresh();
 
+        timeout(viewer->loading || viewer->search ? LOAD_REFRESH_MS : -1);
+        viewer_unlock(viewer);
         ch = getch();
+        viewer_lock(viewer);
+
+        int edited = 0;
 
         if (ch == '\n' || ch == KEY_ENTER) {
-            // Execute search
+            // Keep the results; large documents finish in the background
             break;
         } else if (ch == 27) { // ESC
             // Cancel search
+            search_cancel(viewer);
             viewer->search_term[0] = '\0';
             viewer->search_match_count = 0;
+            viewer->search_error = NULL;
+            search_origin_restore(viewer, &origin);
             break;
         } else if (ch == KEY_BACKSPACE || ch == 127 || ch == 8) {
             // Backspace
             if (cursor_pos > 0) {
                 cursor_pos--;
                 viewer->search_term[cursor_pos] = '\0';
+                edited = 1;
             }
         } else if (ch >= 32 && ch < 127 && cursor_pos < MAX_SEARCH_LEN - 1) {
             // Regular character
             viewer->search_term[cursor_pos++] = ch;
             viewer->search_term[cursor_pos] = '\0';
+            edited = 1;
+        }
+
+        if (edited && viewer->search_term[0]) {
+            search_start(viewer, &cache);
+        } else if (edited) {
+            search_cancel(viewer);
+            viewer->search_match_count = 0;
+            viewer->search_error = NULL;
+            search_origin_restore(viewer, &origin);
         }
     }
 
+    search_cache_free(viewer, &cache);
+    search_origin_free(&origin);
+
     // Disable echo and cursor
     noecho();
     curs_set(0);
-
-    // Build search matches
-    if (viewer->search_term[0]) {
-        build_search_matches(viewer);
-        if (viewer->search_match_count > 0) {
-            viewer->current_match_idx = 0;
-            viewer->current_line = viewer->search_matches[0];
-        }
-    }
 }
 
-/* Initialize viewer */
-int viewer_init(JsonViewer *viewer, const char *json_str) {
-    viewer->json_str = my_strdup(json_str);
-    viewer->current_line = 0;
-    viewer->scroll_offset = 0;
-    viewer->search_term[0] = '\0';
-    viewer->search_match_count = 0;
-    viewer->current_match_idx = 0;
-    viewer->search_mode = 0;
+/* Collapse (1), expand (0) or toggle (-1) the container on a line */
+void collapse_line(JsonViewer *viewer, int line, int collapsed) {
+    if (viewer->ndjson) {
+        JsonViewer *doc;
+        int tok_idx;
+        int record = ndjson_line(viewer, line, &doc, &tok_idx);
+        if (record < 0) return;
 
-    // Parse JSON
-    jsmn_parser parser;
-    jsmn_init(&parser);
-
-    viewer->tokens = malloc(sizeof(jsmntok_t) * MAX_TOKENS);
-    viewer->token_count = jsmn_parse(&parser, json_str, strlen(json_str),
-                                     viewer->tokens, MAX_TOKENS);
-
-    if (viewer->token_count < 0) {
-        fprintf(stderr, "Failed to parse JSON: %d\n", viewer->token_count);
-        return -1;
+        if (collapsed < 0) {
+            collapsed = doc ? !bitset_test(doc->collapsed, tok_idx) : 0;
+        }
+        ndjson_set_collapsed(viewer, record, tok_idx, collapsed);
+        return;
     }
 
-    viewer->visible_tokens = calloc(MAX_TOKENS, sizeof(int));
-    viewer->collapsed      = calloc(viewer->token_count, sizeof(int));
-    viewer->depths         = calloc(viewer->token_count, sizeof(int));
-    viewer->search_matches = calloc(MAX_TOKENS, sizeof(int));
-
-    calculate_depths(viewer->tokens, viewer->token_count, viewer->depths);
+    int tok_idx = get_token_for_line(viewer, line);
+    if (tok_idx < 0) return;
 
-    return 0;
-}
-
-void viewer_cleanup(JsonViewer *viewer) {
-    FREE_PTR(viewer->json_str);
-    FREE_PTR(viewer->tokens);
-    FREE_PTR(viewer->visible_tokens);
-    FREE_PTR(viewer->collapsed);
-    FREE_PTR(viewer->depths);
-    FREE_PTR(viewer->search_matches);
+    if (collapsed < 0) {
+        collapsed = !bitset_test(viewer->collapsed, tok_idx);
+    }
+    set_collapsed(viewer, tok_idx, collapsed);
 }
 
 /* Main viewer loop */
 void viewer_run(JsonViewer *viewer) {
     int ch;
     int running = 1;
+    long long key_time = 0;     /* when the key being handled was read */
 
-    while (running) {
-        // Rebuild visible token list
-        viewer->visible_count = 0;
-        build_visible_tokens(viewer, 0, 0);
+    // The background loader only touches the document between our redraws
+    viewer_lock(viewer);
 
-        // Rebuild search matches if search is active
-        if (viewer->search_term[0]) {
-            build_search_matches(viewer);
-        }
+    while (running) {
+        // Pick up the progress of a background search
+        search_poll(viewer);
 
         // Ensure current line is in bounds
-        if (viewer->current_line >= viewer->visible_count) {
-            viewer->current_line = viewer->visible_count - 1;
+        if (viewer->current_line >= viewer->lines.total) {
+            viewer->current_line = viewer->lines.total - 1;
         }
         if (viewer->current_line < 0) {
             viewer->current_line = 0;
         }
 
         display_json(viewer);
+        if (key_time) {
+            stats_latency(key_time);
+            key_time = 0;
+        }
 
+        // Poll while loading or searching so progress keeps showing up
+        timeout(viewer->loading || viewer->search ? LOAD_REFRESH_MS : -1);
+        viewer_unlock(viewer);
         ch = getch();
+        viewer_lock(viewer);
+        if (ch != ERR) {
+            key_time = stats_now();
+        }
 
         int tok_idx = get_token_for_line(viewer, viewer->current_line);
         if (tok_idx < 0 && ch != 'q' && ch != 'Q' && ch != '/') continue;
 
-        jsmntok_t *tok = tok_idx >= 0 ? &viewer->tokens[tok_idx] : NULL;
         int max_lines = viewer->max_y - 5;
 
         switch(ch) {
@@ -521,8 +581,10 @@ void viewer_run(JsonViewer *viewer) {
 
             case '/':
                 // Enter search mode
+                search_cancel(viewer);
                 viewer->search_term[0] = '\0';
                 viewer->search_match_count = 0;
+                viewer->search_error = NULL;
                 search_input(viewer);
                 break;
 
@@ -536,15 +598,18 @@ void viewer_run(JsonViewer *viewer) {
                 goto_prev_match(viewer);
                 break;
 
-            case 27: // ESC - clear search
+            case 27: // ESC - clear search, stopping it if still running
+                search_cancel(viewer);
                 viewer->search_term[0] = '\0';
                 viewer->search_match_count = 0;
+                viewer->search_error = NULL;
                 viewer->current_match_idx = 0;
+                viewer->current_match_tok = -1;
                 break;
 
             case 'j': // Down
             case KEY_DOWN:
-                if (viewer->current_line < viewer->visible_count - 1) {
+                if (viewer->current_line < viewer->lines.total - 1) {
                     viewer->current_line++;
                 }
                 break;
@@ -558,24 +623,20 @@ void viewer_run(JsonViewer *viewer) {
 
             case 'h': // Collapse
             case KEY_LEFT:
-                if (tok && (tok->type == JSMN_OBJECT || tok->type == JSMN_ARRAY)) {
-                    viewer->collapsed[tok_idx] = 1;
-                }
+                collapse_line(viewer, viewer->current_line, 1);
                 break;
 
             case 'l': // Expand
             case KEY_RIGHT:
-                if (tok && (tok->type == JSMN_OBJECT || tok->type == JSMN_ARRAY)) {
-                    viewer->collapsed[tok_idx] = 0;
-                }
+                collapse_line(viewer, viewer->current_line, 0);
                 break;
 
             case 4: // Ctrl-D
                 {
                     int half_page = max_lines / 2;
                     viewer->current_line += half_page;
-                    if (viewer->current_line >= viewer->visible_count) {
-                        viewer->current_line = viewer->visible_count - 1;
+                    if (viewer->current_line >= viewer->lines.total) {
+                        viewer->current_line = viewer->lines.total - 1;
                     }
                 }
                 break;
@@ -591,9 +652,7 @@ void viewer_run(JsonViewer *viewer) {
                 break;
 
             case ' ': // Space to toggle expand/collapse
-                if (tok && (tok->type == JSMN_OBJECT || tok->type == JSMN_ARRAY)) {
-                    viewer->collapsed[tok_idx] = !viewer->collapsed[tok_idx];
-                }
+                collapse_line(viewer, viewer->current_line, -1);
                 break;
 
             case 'g': // Go to top
@@ -601,42 +660,198 @@ void viewer_run(JsonViewer *viewer) {
                 break;
 
             case 'G': // Go to bottom
-                viewer->current_line = viewer->visible_count - 1;
+                viewer->current_line = viewer->lines.total - 1;
+                break;
+
+            case 'S': // Toggle the stats overlay
+                show_stats = !show_stats;
+                // Have the next frame repaint what the overlay covered
+                screen.max_y = 0;
                 break;
         }
     }
+
+    search_cancel(viewer);
+    viewer_unlock(viewer);
+}
+
+/* The default build stores 32-bit offsets; hand files it cannot address to
+ * the wide-offset build installed next to it. Only returns on failure. */
+void exec_wide_build(char **argv) {
+    char path[4096];
+    ssize_t n = readlink("/proc/self/exe", path, sizeof(path) - sizeof(WIDE_BUILD_SUFFIX));
+    if (n < 0) return;
+
+    memcpy(path + n, WIDE_BUILD_SUFFIX, sizeof(WIDE_BUILD_SUFFIX));
+    execv(path, argv);
+}
+
+/* The --stats report, printed once the terminal is given back */
+static void print_stats(JsonViewer *viewer) {
+    char lines[STATS_MAX_LINES][STATS_LINE_MAX];
+
+    viewer_lock(viewer);
+    int count = stats_report(viewer, lines, STATS_MAX_LINES);
+    viewer_unlock(viewer);
+
+    for (int i = 0; i < count; i++) {
+        fprintf(stderr, "%s\n", lines[i]);
+    }
 }
 
 int main(int argc, char **argv) {
-    if (argc < 2) {
-        fprintf(stderr, "Usage: %s <json_file>\n", argv[0]);
+    const char *path = NULL;
+    int use_index = 0;
+    int records = 0;
+    int skeleton = 0;
+    int usage_error = 0;
+    int batch = 0;
+    int report_stats = 0;
+    BatchOptions options = { BATCH_OUTLINE, NULL, 0, -1 };
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--index") == 0) {
+            use_index = 1;
+        } else if (strcmp(argv[i], "--ndjson") == 0) {
+            records = 1;
+        } else if (strcmp(argv[i], "--skeleton") == 0) {
+            skeleton = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            report_stats = 1;
+        } else if (strcmp(argv[i], "--outline") == 0) {
+            batch = 1;
+            options.outline = 1;
+        } else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            char *end;
+            long depth = strtol(argv[++i], &end, 10);
+            if (*end || end == argv[i] || depth < 0 || depth > JSON_INDEX_MAX_DEPTH) {
+                usage_error = 1;
+            }
+            batch = 1;
+            options.outline = 1;
+            options.depth = (int)depth;
+        } else if ((strcmp(argv[i], "--extract") == 0 || strcmp(argv[i], "--count") == 0) &&
+                   i + 1 < argc) {
+            if (options.term) usage_error = 1;
+            batch = 1;
+            options.mode = argv[i][2] == 'e' ? BATCH_EXTRACT : BATCH_COUNT;
+            options.term = argv[++i];
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            usage_error = 1;
+        }
+    }
+    // With no file named, read what is piped in
+    if (!path && !isatty(STDIN_FILENO)) {
+        path = JSON_SOURCE_STDIN;
+    }
+    if ((options.mode == BATCH_COUNT && options.outline) || (records && skeleton)) {
+        usage_error = 1;
+    }
+    if (!path || usage_error) {
+        fprintf(stderr, "Usage: %s [--index] [--ndjson | --skeleton] [--stats] <json_file | ->\n"
+                        "       %s [--index] [--ndjson | --skeleton] [--stats] [--outline] [--depth N]\n"
+                        "          [--extract TERM | --count TERM] <json_file | ->\n"
+                        "--index keeps the parsed index of a large file next to it, in\n"
+                        "<json_file>" SIDECAR_SUFFIX ", and maps it instead of parsing the next time.\n"
+                        "It takes about %.0f bytes per token.\n",
+                argv[0], argv[0], json_sidecar_token_bytes());
+        return 1;
+    }
+
+    // Regular files are mapped and parsed in place; pipes and standard
+    // input are read chunk by chunk while they are being viewed
+    JsonSource source;
+    long long open_start = stats_now();
+    if (json_source_open(&source, path) < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    stats_add(STATS_READ, open_start);
+
+    if (!records && !skeleton) {
+        records = ndjson_path_matches(path);
+    }
+
+    // Records are parsed one at a time, so only their own offsets need to
+    // fit the build's width
+#ifndef JSMN_WIDE_OFFSETS
+    if (!records && !skeleton && source.len > JSMN_OFFSET_MAX) {
+        json_source_close(&source);
+        exec_wide_build(argv);
+        fprintf(stderr, "%s is larger than 2 GiB and needs the wide-offset build "
+                        "(make wide): %s\n", path, strerror(errno));
         return 1;
     }
+#endif
 
-    char *json_str = 0;
-    FILE *f = NULL;
+    // Large inputs and streams are tokenized in the background so the
+    // first screen shows up right away. With --index, a large mapped file's
+    // index is kept in a sidecar file, so that next time it need not be
+    // parsed at all.
+    JsonViewer viewer;
+    int init_result;
+    char *sidecar_path = NULL;
+    if (skeleton) {
+        init_result = viewer_open_skeleton(&viewer, &source);
+    } else if (records) {
+        init_result = viewer_open_records(&viewer, &source);
+    } else if (source.fd >= 0) {
+        init_result = viewer_start(&viewer, &source, NULL);
+    } else if (source.len >= PROGRESSIVE_MIN_BYTES) {
+        if (use_index && source.mapped) {
+            sidecar_path = json_sidecar_path(path);
+        }
+        if (sidecar_path && viewer_open_sidecar(&viewer, &source, sidecar_path) == 0) {
+            init_result = 0;
+        } else {
+            init_result = viewer_start(&viewer, &source, sidecar_path);
+        }
+    } else {
+        json_source_advise(&source, 1);
+        init_result = viewer_init(&viewer, source.data, source.len);
+        json_source_advise(&source, 0);
+    }
 
-    // Try to load from file if it exists
-    f = fopen(argv[1], "r");
-    if (f) {
-        fseek(f, 0, SEEK_END);
-        long size = ftell(f);
-        fseek(f, 0, SEEK_SET);
+    if (init_result < 0) {
+        json_source_close(&source);
+        free(sidecar_path);
+        return 1;
+    }
 
-        json_str = malloc(size + 1);
-        if (!json_str) {
-            fprintf(stderr, "Memory allocation failed\n");
-            fclose(f);
+    // Without a terminal everything is written to standard output at once
+    if (batch) {
+#ifndef JSMN_WIDE_OFFSETS
+        // A compressed file only shows how large it is once decompressed,
+        // but can be read again from the start by the wide-offset build;
+        // standard input cannot
+        if (viewer_wait(&viewer) == JSON_ERROR_TOO_LARGE && strcmp(path, JSON_SOURCE_STDIN) != 0) {
+            viewer_cleanup(&viewer);
+            json_source_close(&source);
+            free(sidecar_path);
+            exec_wide_build(argv);
+            fprintf(stderr, "%s is larger than 2 GiB and needs the wide-offset build "
+                            "(make wide): %s\n", path, strerror(errno));
             return 1;
         }
-        fread(json_str, 1, size, f);
-        json_str[size] = '\0';
-        fclose(f);
+#endif
+        int result = batch_run(&viewer, &options, STDOUT_FILENO);
+        if (report_stats) {
+            print_stats(&viewer);
+        }
+        viewer_cleanup(&viewer);
+        json_source_close(&source);
+        free(sidecar_path);
+        return result < 0 ? 1 : 0;
     }
 
-    JsonViewer viewer;
-    if (viewer_init(&viewer, json_str) < 0) {
-        if (f) FREE_PTR(json_str);
+    // Keys come from the terminal even when the document is piped in
+    if (!isatty(STDIN_FILENO) && !freopen("/dev/tty", "r", stdin)) {
+        fprintf(stderr, "Cannot open terminal: %s\n", strerror(errno));
+        viewer_cleanup(&viewer);
+        json_source_close(&source);
+        free(sidecar_path);
         return 1;
     }
 
@@ -646,6 +861,8 @@ int main(int argc, char **argv) {
     noecho();
     keypad(stdscr, TRUE);
     curs_set(0);
+    // Let refresh scroll the terminal rather than redraw moved rows
+    idlok(stdscr, TRUE);
 
     // Initialize colors if available
     if (has_colors()) {
@@ -658,9 +875,13 @@ int main(int argc, char **argv) {
     // Cleanup ncurses
     endwin();
 
-    viewer_cleanup(&viewer);
+    if (report_stats) {
+        print_stats(&viewer);
+    }
 
-    if (f) FREE_PTR(json_str);
+    viewer_cleanup(&viewer);
+    json_source_close(&source);
+    free(sidecar_path);
 
     return 0;
 }
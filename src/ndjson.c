@@ -0,0 +1,483 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitset.h"
+#include "ndjson.h"
+#include "search.h"
+
+#define NDJSON_INITIAL_RECORDS 4096
+#define NDJSON_INITIAL_PARSED 16
+
+static inline int is_blank(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+int ndjson_path_matches(const char *path) {
+    static const char *const suffixes[] = { ".ndjson", ".jsonl", ".ldjson" };
+    static const char *const compressed[] = { ".gz", ".zst" };
+    size_t len = strlen(path);
+
+    // Compressed input is recognised by its contents, whatever its name
+    for (size_t i = 0; i < sizeof(compressed) / sizeof(compressed[0]); i++) {
+        size_t n = strlen(compressed[i]);
+        if (len >= n && strcmp(path + len - n, compressed[i]) == 0) {
+            len -= n;
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+        size_t n = strlen(suffixes[i]);
+        if (len >= n && strncmp(path + len - n, suffixes[i], n) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int ndjson_attach(JsonViewer *viewer, int skeleton) {
+    viewer->ndjson = calloc(1, sizeof(NdjsonIndex));
+    if (!viewer->ndjson) return -1;
+    viewer->ndjson->skeleton = skeleton;
+
+    if (viewer_reserve(viewer, NDJSON_INITIAL_RECORDS) < 0) {
+        ndjson_detach(viewer);
+        return -1;
+    }
+    viewer->ndjson->starts[0] = 0;
+    return 0;
+}
+
+void ndjson_detach(JsonViewer *viewer) {
+    NdjsonIndex *ndjson = viewer->ndjson;
+    if (!ndjson) return;
+
+    for (int i = 0; i < ndjson->parsed_count; i++) {
+        JsonViewer *doc = ndjson->parsed[i].doc;
+        if (doc) {
+            viewer_cleanup(doc);
+            free(doc);
+        }
+    }
+    free(ndjson->parsed);
+    FREE_PTR(viewer->ndjson);
+}
+
+/* Make room for one more record */
+static int grow_records(JsonViewer *viewer) {
+    NdjsonIndex *ndjson = viewer->ndjson;
+
+    if (ndjson->count < ndjson->capacity) return 0;
+    if (ndjson->capacity > (int)(JSON_INDEX_MAX_TOKENS / 2) ||
+        viewer_reserve(viewer, ndjson->capacity * 2) < 0) {
+        return JSMN_ERROR_NOMEM;
+    }
+    return 0;
+}
+
+/* Match brackets byte by byte, skipping over strings with memchr. A ','
+ * one level down ends a record; the record runs on to just after it, so
+ * the records with the blanks and commas between them cover the container
+ * from its opening bracket to its closing one. Nothing is checked beyond
+ * that, a member that is not valid JSON only fails once it is parsed. */
+static int skeleton_scan_chunk(JsonViewer *viewer, size_t chunk) {
+    NdjsonIndex *ndjson = viewer->ndjson;
+    const char *js = viewer->json_str;
+    size_t len = viewer->json_len;
+    size_t pos = viewer->parsed_len;
+    size_t end = len - pos > chunk ? pos + chunk : len;
+
+    while (pos < end && !ndjson->closed) {
+        if (ndjson->in_string) {
+            const char *quote = memchr(js + pos, '"', end - pos);
+            if (!quote) {
+                pos = end;
+                break;
+            }
+            pos = quote - js + 1;
+            if (!json_escaped(js, pos - 1)) ndjson->in_string = 0;
+            continue;
+        }
+
+        char c = js[pos++];
+        if (is_blank(c)) continue;
+
+        if (ndjson->depth == 0) {
+            if (c != '[' && c != '{') return JSMN_ERROR_INVAL;
+            ndjson->keyed = c == '{';
+            ndjson->depth = 1;
+            ndjson->starts[0] = pos;
+            continue;
+        }
+
+        switch (c) {
+        case '"':
+            ndjson->in_string = 1;
+            break;
+        case '[':
+        case '{':
+            ndjson->depth++;
+            break;
+        case ']':
+        case '}':
+            if (--ndjson->depth > 0) break;
+            // An empty container, or a ',' after the last member, leaves
+            // nothing to show for the record it would have started
+            if (ndjson->filled) {
+                if (grow_records(viewer) < 0) return JSMN_ERROR_NOMEM;
+                ndjson->count++;
+            }
+            ndjson->starts[ndjson->count] = pos - 1;
+            ndjson->closed = 1;
+            continue;
+        case ',':
+            if (ndjson->depth > 1) break;
+            if (grow_records(viewer) < 0) return JSMN_ERROR_NOMEM;
+            ndjson->starts[++ndjson->count] = pos;
+            ndjson->filled = 0;
+            continue;
+        }
+        ndjson->filled = 1;
+    }
+
+    if (visible_lines_append(&viewer->lines, ndjson->count) < 0) {
+        return JSMN_ERROR_NOMEM;
+    }
+
+    // Whatever follows the container is not looked at
+    viewer->parsed_len = ndjson->closed ? len : pos;
+    if (ndjson->closed) return 0;
+    if (pos < len || viewer->input_open) return 1;
+    return JSMN_ERROR_PART;
+}
+
+/* Scan line by line with memchr; a line with anything but blanks on it is
+ * a record. The scan always stops at the start of a line. */
+int ndjson_scan_chunk(JsonViewer *viewer, size_t chunk) {
+    NdjsonIndex *ndjson = viewer->ndjson;
+    if (ndjson->skeleton) return skeleton_scan_chunk(viewer, chunk);
+
+    const char *js = viewer->json_str;
+    size_t len = viewer->json_len;
+    size_t pos = viewer->parsed_len;
+    size_t end = len - pos > chunk ? pos + chunk : len;
+
+    while (pos < end) {
+        const char *newline = memchr(js + pos, '\n', end - pos);
+        size_t line_end;
+
+        if (newline) {
+            line_end = newline - js + 1;
+        } else if (end == len && !viewer->input_open) {
+            line_end = len;
+        } else {
+            // The line goes on past this chunk
+            break;
+        }
+
+        size_t first = pos;
+        while (first < line_end && is_blank(js[first])) first++;
+
+        if (first < line_end) {
+            if (grow_records(viewer) < 0) return JSMN_ERROR_NOMEM;
+            ndjson->starts[ndjson->count++] = pos;
+        }
+        // Blank lines are folded into the record before them
+        ndjson->starts[ndjson->count] = line_end;
+        pos = line_end;
+    }
+
+    if (visible_lines_append(&viewer->lines, ndjson->count) < 0) {
+        return JSMN_ERROR_NOMEM;
+    }
+
+    // A line longer than the chunk makes no progress, so widen the window
+    // until it ends
+    viewer->chunk_size = (pos == viewer->parsed_len && end < len) ? chunk * 2 : LOAD_CHUNK_BYTES;
+    viewer->parsed_len = pos;
+
+    return pos < len || viewer->input_open ? 1 : 0;
+}
+
+/* End of the string starting at text, just past its closing quote, or
+ * NULL if it does not close before end */
+static const char *string_end(const char *text, const char *end) {
+    const char *quote = text;
+
+    while ((quote = memchr(quote + 1, '"', end - quote - 1)) != NULL) {
+        if (!json_escaped(text, quote - text)) return quote + 1;
+    }
+    return NULL;
+}
+
+/* The key of a member and the blanks and ':' after it, or nothing if the
+ * member does not start out like that; its value then fails to parse */
+static const char *skip_key(const char *text, const char *end) {
+    const char *key_end = *text == '"' ? string_end(text, end) : NULL;
+    if (!key_end) return text;
+
+    const char *value = key_end;
+    while (value < end && is_blank(*value)) value++;
+    if (value == end || *value != ':') return text;
+    return value + 1;
+}
+
+const char *ndjson_record_text(const JsonViewer *viewer, int record, size_t *len) {
+    const NdjsonIndex *ndjson = viewer->ndjson;
+    const char *text = viewer->json_str + ndjson->starts[record];
+    const char *end = viewer->json_str + ndjson->starts[record + 1];
+
+    while (text < end && is_blank(*text)) text++;
+    if (ndjson->skeleton) {
+        if (end > text && end[-1] == ',') end--;
+        if (ndjson->keyed) {
+            text = skip_key(text, end);
+            while (text < end && is_blank(*text)) text++;
+        }
+    }
+    while (end > text && is_blank(end[-1])) end--;
+
+    *len = end - text;
+    return text;
+}
+
+const char *ndjson_record_key(const JsonViewer *viewer, int record, size_t *len) {
+    const NdjsonIndex *ndjson = viewer->ndjson;
+    if (!ndjson->skeleton || !ndjson->keyed) return NULL;
+
+    const char *text = viewer->json_str + ndjson->starts[record];
+    const char *end = viewer->json_str + ndjson->starts[record + 1];
+    while (text < end && is_blank(*text)) text++;
+
+    const char *key_end = text < end && *text == '"' ? string_end(text, end) : NULL;
+    if (!key_end) return NULL;
+
+    *len = key_end - text;
+    return text;
+}
+
+/* A line holds exactly one JSON value, so anything after the first one,
+ * like a second word jsmn would read as another primitive, is an error */
+static int single_value(const JsonViewer *doc, size_t len) {
+    if (doc->token_count == 0) return 0;
+    // A string's token ends before its closing quote
+    size_t end = doc->tokens[0].end + (doc->tokens[0].type == JSMN_STRING);
+    return end == len;
+}
+
+/* Position of a record in the parsed list, or where it would go */
+static int find_parsed(const NdjsonIndex *ndjson, int record) {
+    int lo = 0, hi = ndjson->parsed_count;
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (ndjson->parsed[mid].record < record) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+JsonViewer *ndjson_parsed(const JsonViewer *viewer, int record, int *failed) {
+    const NdjsonIndex *ndjson = viewer->ndjson;
+    int i = find_parsed(ndjson, record);
+    int found = i < ndjson->parsed_count && ndjson->parsed[i].record == record;
+
+    if (failed) *failed = found && !ndjson->parsed[i].doc;
+    return found ? ndjson->parsed[i].doc : NULL;
+}
+
+/* What a parsed record takes up: the arena its tables sit in, which is
+ * shrunk to its tokens once parsed. Its text belongs to the document it
+ * came from. */
+static size_t record_bytes(const JsonViewer *doc) {
+    return sizeof(JsonViewer) + doc->arena.size;
+}
+
+/* Release collapsed records, least recently used first, until the rest fit
+ * in NDJSON_PARSED_MAX_BYTES. A collapsed record shows on one line whether
+ * it is parsed or not, so the layout stays as it is, and the record is
+ * simply parsed again once it is next needed. */
+static void release_records(JsonViewer *viewer, int keep) {
+    NdjsonIndex *ndjson = viewer->ndjson;
+
+    while (ndjson->parsed_bytes > NDJSON_PARSED_MAX_BYTES) {
+        int oldest = -1;
+        for (int i = 0; i < ndjson->parsed_count; i++) {
+            const NdjsonRecord *parsed = &ndjson->parsed[i];
+            if (!parsed->doc || parsed->record == keep ||
+                !bitset_test(parsed->doc->collapsed, 0)) {
+                continue;
+            }
+            if (oldest < 0 || parsed->used < ndjson->parsed[oldest].used) oldest = i;
+        }
+        if (oldest < 0) return;
+
+        viewer_cleanup(ndjson->parsed[oldest].doc);
+        free(ndjson->parsed[oldest].doc);
+        ndjson->parsed_bytes -= ndjson->parsed[oldest].bytes;
+        memmove(&ndjson->parsed[oldest], &ndjson->parsed[oldest + 1],
+                sizeof(NdjsonRecord) * (ndjson->parsed_count - oldest - 1));
+        ndjson->parsed_count--;
+    }
+}
+
+JsonViewer *ndjson_record(JsonViewer *viewer, int record) {
+    NdjsonIndex *ndjson = viewer->ndjson;
+    int i = find_parsed(ndjson, record);
+
+    if (i < ndjson->parsed_count && ndjson->parsed[i].record == record) {
+        ndjson->parsed[i].used = ++ndjson->clock;
+        return ndjson->parsed[i].doc;
+    }
+
+    if (ndjson->parsed_count == ndjson->parsed_capacity) {
+        int capacity = ndjson->parsed_capacity ? ndjson->parsed_capacity * 2 : NDJSON_INITIAL_PARSED;
+        NdjsonRecord *parsed = realloc(ndjson->parsed, sizeof(NdjsonRecord) * capacity);
+        if (!parsed) return NULL;
+        ndjson->parsed = parsed;
+        ndjson->parsed_capacity = capacity;
+    }
+
+    JsonViewer *doc = malloc(sizeof(JsonViewer));
+    if (!doc) return NULL;
+
+    size_t len;
+    const char *text = ndjson_record_text(viewer, record, &len);
+    if (viewer_parse(doc, text, len) < 0) {
+        FREE_PTR(doc);
+    } else if (!single_value(doc, len)) {
+        viewer_cleanup(doc);
+        FREE_PTR(doc);
+    }
+
+    if (doc) {
+        // Tables are reserved for a token per byte of the record; a
+        // failure to shrink them only costs memory
+        viewer_shrink(doc);
+        set_collapsed(doc, 0, 1);
+        search_record(viewer, record, doc);
+    }
+
+    // A record that does not parse is remembered too, so that it is not
+    // parsed again on every redraw; its line now shows that it failed
+    viewer->revision++;
+    memmove(&ndjson->parsed[i + 1], &ndjson->parsed[i],
+            sizeof(NdjsonRecord) * (ndjson->parsed_count - i));
+    ndjson->parsed[i].record = record;
+    ndjson->parsed[i].doc = doc;
+    ndjson->parsed[i].bytes = doc ? record_bytes(doc) : 0;
+    ndjson->parsed[i].used = ++ndjson->clock;
+    ndjson->parsed_count++;
+    ndjson->parsed_bytes += ndjson->parsed[i].bytes;
+
+    release_records(viewer, record);
+    return doc;
+}
+
+void ndjson_rebase(JsonViewer *viewer) {
+    NdjsonIndex *ndjson = viewer->ndjson;
+
+    for (int i = 0; i < ndjson->parsed_count; i++) {
+        JsonViewer *doc = ndjson->parsed[i].doc;
+        if (doc) {
+            doc->json_str = ndjson_record_text(viewer, ndjson->parsed[i].record, &doc->json_len);
+        }
+    }
+}
+
+int ndjson_line(const JsonViewer *viewer, int line, JsonViewer **doc, int *tok) {
+    int record = visible_lines_token(&viewer->lines, line);
+
+    *doc = NULL;
+    *tok = -1;
+    if (record < 0) return -1;
+
+    JsonViewer *parsed = ndjson_parsed(viewer, record, NULL);
+    if (parsed && !bitset_test(parsed->collapsed, 0)) {
+        *doc = parsed;
+        *tok = visible_lines_token(&parsed->lines,
+                                   line - visible_lines_start(&viewer->lines, record));
+    }
+    return record;
+}
+
+int ndjson_record_line(const JsonViewer *viewer, int record) {
+    return visible_lines_start(&viewer->lines, record);
+}
+
+int ndjson_set_collapsed(JsonViewer *viewer, int record, int tok, int collapsed) {
+    // Collapsing a record that was never parsed has nothing to do
+    JsonViewer *doc = collapsed ? ndjson_parsed(viewer, record, NULL)
+                                : ndjson_record(viewer, record);
+
+    if (!doc || !set_collapsed(doc, tok < 0 ? 0 : tok, collapsed)) return 0;
+
+    ndjson_relayout(viewer, record);
+    return 1;
+}
+
+void ndjson_relayout(JsonViewer *viewer, int record) {
+    JsonViewer *doc = ndjson_parsed(viewer, record, NULL);
+    visible_lines_resize(&viewer->lines, record, doc ? doc->lines.total : 1);
+}
+
+void ndjson_scratch_init(NdjsonScratch *scratch) {
+    memset(&scratch->doc, 0, sizeof(scratch->doc));
+    json_index_init(&scratch->doc.index);
+}
+
+static int scratch_grow(JsonViewer *doc) {
+    if (doc->token_capacity > (int)(JSON_INDEX_MAX_TOKENS / 2)) return -1;
+
+    int capacity = doc->token_capacity ? doc->token_capacity * 2 : INITIAL_TOKENS;
+    jsmntok_t *tokens = realloc(doc->tokens, sizeof(jsmntok_t) * capacity);
+    if (!tokens) return -1;
+    doc->tokens = tokens;
+
+    // The tokenizer writes its parent links into the index
+    if (json_index_reserve(&doc->index, capacity) < 0) return -1;
+    doc->token_capacity = capacity;
+    return 0;
+}
+
+int ndjson_scratch_parse(NdjsonScratch *scratch, const JsonViewer *viewer, int record) {
+    JsonViewer *doc = &scratch->doc;
+    size_t len;
+    const char *text = ndjson_record_text(viewer, record, &len);
+    int count;
+
+    doc->json_str = text;
+    doc->json_len = len;
+    doc->token_count = 0;
+    if (len > (size_t)JSMN_OFFSET_MAX) return JSMN_ERROR_NOMEM;
+
+    // jsmn treats a NULL token array as a request to only count tokens
+    if (!doc->tokens && scratch_grow(doc) < 0) return JSMN_ERROR_NOMEM;
+
+    jsmn_init(&scratch->parser);
+    for (;;) {
+        scratch->parser.parents = doc->index.parents;
+        count = jsmn_parse(&scratch->parser, text, len, doc->tokens, doc->token_capacity);
+        if (count != JSMN_ERROR_NOMEM) break;
+        if (scratch_grow(doc) < 0) return JSMN_ERROR_NOMEM;
+    }
+    if (count < 0) return count;
+    doc->token_count = count;
+    if (!single_value(doc, len)) return JSMN_ERROR_INVAL;
+
+    json_index_reset(&doc->index);
+    if (json_index_extend(&doc->index, doc->tokens, count) < 0) {
+        return JSMN_ERROR_NOMEM;
+    }
+    json_index_finish(&doc->index);
+
+    return count;
+}
+
+void ndjson_scratch_free(NdjsonScratch *scratch) {
+    FREE_PTR(scratch->doc.tokens);
+    json_index_free(&scratch->doc.index);
+}
@@ -0,0 +1,116 @@
+#ifndef NDJSON_H
+#define NDJSON_H
+
+#include <stddef.h>
+
+#include "viewer.h"
+
+/* JSON Lines input: one JSON value per line. Opening a file only scans it
+ * for line breaks. Every record is laid out as a single collapsed entry of
+ * viewer->lines, and its tokens are parsed into a document of its own
+ * once it is expanded or stepped into by a search. Searches parse records
+ * into scratch space and keep nothing but one bit per record.
+ *
+ * Skeleton mode shows any document that way, with the members of its
+ * top-level array or object for records. They are found by matching
+ * brackets and skipping strings, without tokenizing anything, so only the
+ * records that are expanded ever have tokens. Records parsed for display
+ * are released again, least recently used first, once they take up more
+ * than NDJSON_PARSED_MAX_BYTES and are collapsed. */
+
+/* Table bytes of parsed records kept around for display */
+#define NDJSON_PARSED_MAX_BYTES ((size_t)256 << 20)
+
+/* A record parsed for display */
+typedef struct {
+    int record;
+    JsonViewer *doc;        /* NULL if the record is not valid JSON */
+    size_t bytes;           /* of its tables */
+    unsigned int used;      /* NdjsonIndex.clock when last asked for */
+} NdjsonRecord;
+
+typedef struct NdjsonIndex {
+    size_t *starts;         /* record i spans [starts[i], starts[i + 1]) */
+    int count;
+    int capacity;           /* records the viewer's tables have room for */
+    NdjsonRecord *parsed;   /* sorted by record */
+    int parsed_count;
+    int parsed_capacity;
+    size_t parsed_bytes;
+    unsigned int clock;
+
+    /* Skeleton mode, and where its scan stopped */
+    int skeleton;
+    int keyed;              /* the container is an object: records start with a key */
+    int depth;              /* nesting, 0 until the container opens and once it closes */
+    int in_string;
+    int filled;             /* the record being scanned has more than blanks */
+    int closed;
+} NdjsonIndex;
+
+/* A record parsed for a one-off look, into tables reused from one record
+ * to the next. Only the tokens, token_count, json_str, json_len and index
+ * of doc are filled in. */
+typedef struct {
+    JsonViewer doc;
+    jsmn_parser parser;
+} NdjsonScratch;
+
+/* Files opened as JSON Lines without being asked to */
+int ndjson_path_matches(const char *path);
+
+/* Switch a freshly set up viewer to JSON Lines mode, or to skeleton mode.
+ * Returns 0 or -1. */
+int ndjson_attach(JsonViewer *viewer, int skeleton);
+void ndjson_detach(JsonViewer *viewer);
+
+/* Find the records in the next chunk of input; same contract as the
+ * tokenizer's chunks. Returns 1 if input remains, 0 once every record is
+ * known, or a negative jsmnerr: JSMN_ERROR_NOMEM, or in skeleton mode
+ * JSMN_ERROR_INVAL if the document is not an array or object and
+ * JSMN_ERROR_PART if it ends before the container does. */
+int ndjson_scan_chunk(JsonViewer *viewer, size_t chunk);
+
+/* Text of a record without the blanks around it. In skeleton mode that
+ * leaves out the ',' after it and, for an object's member, its key. */
+const char *ndjson_record_text(const JsonViewer *viewer, int record, size_t *len);
+
+/* Key of an object's member in skeleton mode, quotes and all, or NULL */
+const char *ndjson_record_key(const JsonViewer *viewer, int record, size_t *len);
+
+/* The document of a record, parsed now unless it already is, with the
+ * matches of the current search term marked. A freshly parsed record
+ * starts out collapsed. NULL if the record is not valid JSON. Parsing may
+ * release other collapsed records, so documents of those must not be held
+ * on to across the call. */
+JsonViewer *ndjson_record(JsonViewer *viewer, int record);
+
+/* Like ndjson_record, but never parses. failed is set to 1 if the record
+ * was found not to parse. */
+JsonViewer *ndjson_parsed(const JsonViewer *viewer, int record, int *failed);
+
+/* Point the parsed records back into viewer->json_str after it moved */
+void ndjson_rebase(JsonViewer *viewer);
+
+/* Record shown on a line, or -1 if out of range. *doc and *tok are set to
+ * the token drawn there, or to NULL and -1 on the collapsed line of a
+ * record. */
+int ndjson_line(const JsonViewer *viewer, int line, JsonViewer **doc, int *tok);
+
+/* First line of a record */
+int ndjson_record_line(const JsonViewer *viewer, int record);
+
+/* Collapse or expand a token of a record, tok -1 standing for the record
+ * itself. Returns 1 if the layout changed. */
+int ndjson_set_collapsed(JsonViewer *viewer, int record, int tok, int collapsed);
+
+/* Bring the record's entry in viewer->lines in line with its document,
+ * after nodes were expanded or collapsed there directly */
+void ndjson_relayout(JsonViewer *viewer, int record);
+
+void ndjson_scratch_init(NdjsonScratch *scratch);
+/* Returns the token count, or a negative jsmnerr */
+int ndjson_scratch_parse(NdjsonScratch *scratch, const JsonViewer *viewer, int record);
+void ndjson_scratch_free(NdjsonScratch *scratch);
+
+#endif /* NDJSON_H */
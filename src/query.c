@@ -0,0 +1,375 @@
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "query.h"
+
+/* The prefilter compares 16 bytes at a time; SSE2 is part of the x86-64
+ * baseline, so there is nothing to dispatch at runtime */
+#if !defined(JSMN_NO_SIMD) && defined(__SSE2__) &&                            \
+    (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_SIMD_X86
+#include <emmintrin.h>
+#endif
+
+/* ASCII-only lower case, matching what tolower() does in the C locale
+ * without the function call and table lookup */
+static inline unsigned char fold_byte(unsigned char c) {
+    return (unsigned)(c - 'A') < 26u ? c + ('a' - 'A') : c;
+}
+
+void search_compile(SearchPattern *pattern, const char *term) {
+    size_t len = 0;
+
+    while (term[len] && len < MAX_SEARCH_LEN - 1) {
+        pattern->needle[len] = fold_byte((unsigned char)term[len]);
+        len++;
+    }
+    pattern->needle[len] = '\0';
+    pattern->len = len;
+}
+
+/* Compare the whole needle at text; the prefilter already checked its first
+ * and last bytes up to case */
+static inline int matches_at(const SearchPattern *pattern, const char *text) {
+    for (size_t i = 0; i < pattern->len; i++) {
+        if (fold_byte((unsigned char)text[i]) != (unsigned char)pattern->needle[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+const char *search_span(const SearchPattern *pattern, const char *text, size_t len) {
+    size_t n = pattern->len;
+
+    if (n == 0) return text;
+    if (len < n) return NULL;
+
+    // Setting bit 5 folds ASCII letters to lower case. It also pairs a few
+    // punctuation bytes, which only costs a rejected candidate.
+    unsigned char first = (unsigned char)pattern->needle[0] | 0x20;
+    unsigned char last = (unsigned char)pattern->needle[n - 1] | 0x20;
+    size_t end = len - n + 1;   /* candidate starts are [0, end) */
+    size_t pos = 0;
+
+#ifdef SEARCH_SIMD_X86
+    // Keep only the positions where both the first and the last byte of the
+    // needle line up, then verify those one by one
+    const __m128i case_bit = _mm_set1_epi8(0x20);
+    const __m128i want_first = _mm_set1_epi8((char)first);
+    const __m128i want_last = _mm_set1_epi8((char)last);
+
+    for (; pos + 16 <= end; pos += 16) {
+        __m128i head = _mm_loadu_si128((const __m128i *)(text + pos));
+        __m128i tail = _mm_loadu_si128((const __m128i *)(text + pos + n - 1));
+        head = _mm_cmpeq_epi8(_mm_or_si128(head, case_bit), want_first);
+        tail = _mm_cmpeq_epi8(_mm_or_si128(tail, case_bit), want_last);
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(head, tail));
+
+        while (mask) {
+            const char *candidate = text + pos + __builtin_ctz(mask);
+            if (matches_at(pattern, candidate)) return candidate;
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for (; pos < end; pos++) {
+        if (((unsigned char)text[pos] | 0x20) == first &&
+            ((unsigned char)text[pos + n - 1] | 0x20) == last &&
+            matches_at(pattern, text + pos)) {
+            return text + pos;
+        }
+    }
+
+    return NULL;
+}
+
+/* Parse the steps of a path query after the leading $ */
+static int parse_path(Query *query, const char **error) {
+    const char *p = query->source + 1;
+
+    query->step_count = 0;
+    while (*p) {
+        QueryStep step;
+
+        memset(&step, 0, sizeof(step));
+        if (p[0] == '.' && p[1] == '.') {
+            step.descendant = 1;
+            p += 2;
+        } else if (*p == '.') {
+            p++;
+        } else if (*p != '[') {
+            *error = "expected . or [";
+            return -1;
+        }
+
+        if (*p == '[') {
+            p++;
+            if (*p == '*') {
+                step.selector = QUERY_STEP_ANY;
+                p++;
+            } else if (*p == '\'' || *p == '"') {
+                char quote = *p++;
+                step.selector = QUERY_STEP_NAME;
+                step.name = p;
+                while (*p && *p != quote) p++;
+                if (!*p) {
+                    *error = "unterminated name";
+                    return -1;
+                }
+                step.name_len = p - step.name;
+                p++;
+            } else if (*p >= '0' && *p <= '9') {
+                char *end;
+                long index = strtol(p, &end, 10);
+                if (index > INT_MAX) {
+                    *error = "index out of range";
+                    return -1;
+                }
+                step.selector = QUERY_STEP_INDEX;
+                step.index = (int)index;
+                p = end;
+            } else {
+                *error = "expected *, index or quoted name";
+                return -1;
+            }
+            if (*p != ']') {
+                *error = "missing ]";
+                return -1;
+            }
+            p++;
+        } else if (*p == '*') {
+            step.selector = QUERY_STEP_ANY;
+            p++;
+        } else {
+            step.selector = QUERY_STEP_NAME;
+            step.name = p;
+            while (*p && *p != '.' && *p != '[') p++;
+            step.name_len = p - step.name;
+            if (step.name_len == 0) {
+                *error = "empty name";
+                return -1;
+            }
+        }
+
+        if (query->step_count == QUERY_MAX_STEPS) {
+            *error = "too many steps";
+            return -1;
+        }
+        query->steps[query->step_count++] = step;
+    }
+
+    return 0;
+}
+
+int query_compile(Query *query, const char *term, const char **error) {
+    strncpy(query->source, term, MAX_SEARCH_LEN - 1);
+    query->source[MAX_SEARCH_LEN - 1] = '\0';
+    query->regex = NULL;
+    query->step_count = 0;
+
+    if (query->source[0] == '$') {
+        query->kind = QUERY_PATH;
+        return parse_path(query, error);
+    }
+
+    if (strncmp(query->source, "re:", 3) == 0) {
+        regex_t re;
+
+        query->kind = QUERY_REGEX;
+        query->regex = query->source + 3;
+
+        // Catch syntax errors now rather than in every worker
+        if (query_regcomp(query, &re) < 0) {
+            *error = "invalid regex";
+            return -1;
+        }
+        regfree(&re);
+        return 0;
+    }
+
+    query->kind = QUERY_TEXT;
+    search_compile(&query->pattern, query->source);
+    return 0;
+}
+
+int query_regcomp(const Query *query, regex_t *re) {
+    return regcomp(re, query->regex, REG_EXTENDED | REG_ICASE | REG_NOSUB) == 0 ? 0 : -1;
+}
+
+int query_match_span(const Query *query, const regex_t *re, const char *text, size_t len) {
+    if (len == 0) return 0;
+
+    // Spans are matched in place, straight out of the source text
+    if (query->kind == QUERY_REGEX) {
+        regmatch_t span;
+        span.rm_so = 0;
+        span.rm_eo = len;
+        return regexec(re, text, 1, &span, REG_STARTEND) == 0;
+    }
+
+    return search_span(&query->pattern, text, len) != NULL;
+}
+
+int query_match_token(const Query *query, const regex_t *re,
+                      const JsonViewer *viewer, int tok_idx) {
+    const jsmntok_t *tok = &viewer->tokens[tok_idx];
+
+    // Don't match on object/array containers themselves
+    if (tok->type == JSMN_OBJECT || tok->type == JSMN_ARRAY) {
+        return 0;
+    }
+
+    if (tok->end <= tok->start) return 0;
+    return query_match_span(query, re, viewer->json_str + tok->start, tok->end - tok->start);
+}
+
+static int hex_value(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/* The code point of the four hex digits at p, or -1 */
+static long hex4(const char *p, const char *end) {
+    long value = 0;
+
+    if (end - p < 4) return -1;
+    for (int i = 0; i < 4; i++) {
+        int digit = hex_value(p[i]);
+        if (digit < 0) return -1;
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+/* Decode the escape sequence at p, just past its backslash, into out as
+ * UTF-8. Returns the bytes written, or 0 if the sequence is invalid, and
+ * moves p past it. */
+static size_t decode_escape(const char **p, const char *end, char *out) {
+    const char *s = *p;
+    long cp;
+
+    if (s == end) return 0;
+    switch (*s) {
+        case '"': case '\\': case '/': out[0] = *s; *p = s + 1; return 1;
+        case 'b': out[0] = '\b'; *p = s + 1; return 1;
+        case 'f': out[0] = '\f'; *p = s + 1; return 1;
+        case 'n': out[0] = '\n'; *p = s + 1; return 1;
+        case 'r': out[0] = '\r'; *p = s + 1; return 1;
+        case 't': out[0] = '\t'; *p = s + 1; return 1;
+        case 'u': break;
+        default: return 0;
+    }
+
+    cp = hex4(s + 1, end);
+    if (cp < 0) return 0;
+    s += 5;
+    // A high surrogate pairs with the \uXXXX low surrogate after it
+    if (cp >= 0xD800 && cp < 0xDC00 && end - s >= 6 && s[0] == '\\' && s[1] == 'u') {
+        long low = hex4(s + 2, end);
+        if (low >= 0xDC00 && low < 0xE000) {
+            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+            s += 6;
+        }
+    }
+    *p = s;
+
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+/* Whether a key as it appears in the document, escapes and all, spells
+ * name. Keys without a backslash are compared as they are. */
+static int key_equals(const char *key, size_t key_len, const char *name, size_t name_len) {
+    if (!memchr(key, '\\', key_len)) {
+        return key_len == name_len && memcmp(key, name, key_len) == 0;
+    }
+
+    const char *p = key, *end = key + key_len;
+    size_t matched = 0;
+    while (p < end) {
+        char decoded[4];
+        size_t n;
+        if (*p == '\\') {
+            p++;
+            n = decode_escape(&p, end, decoded);
+            if (n == 0) return 0;
+        } else {
+            decoded[0] = *p++;
+            n = 1;
+        }
+        if (name_len - matched < n || memcmp(name + matched, decoded, n) != 0) return 0;
+        matched += n;
+    }
+    return matched == name_len;
+}
+
+/* Does a step select the value with this key (object members) or this
+ * position (array elements)? */
+static int step_selects(const QueryStep *step, const char *key, size_t key_len, int ordinal) {
+    switch (step->selector) {
+        case QUERY_STEP_ANY:
+            return 1;
+        case QUERY_STEP_INDEX:
+            return !key && ordinal == step->index;
+        case QUERY_STEP_NAME:
+            return key && key_equals(key, key_len, step->name, step->name_len);
+    }
+    return 0;
+}
+
+uint64_t query_path_step(const Query *query, uint64_t states,
+                         const JsonViewer *viewer, int tok_idx, int ordinal) {
+    int container = viewer->index.parents[tok_idx];
+
+    // An object member's value comes right after its key
+    if (container >= 0 && token_type(&viewer->index, container) == JSMN_OBJECT) {
+        const jsmntok_t *key = &viewer->tokens[tok_idx - 1];
+        return query_path_member(query, states, viewer->json_str + key->start,
+                                 key->end - key->start, ordinal);
+    }
+    return query_path_member(query, states, NULL, 0, ordinal);
+}
+
+uint64_t query_path_member(const Query *query, uint64_t states,
+                           const char *key, size_t key_len, int ordinal) {
+    uint64_t next = 0;
+
+    while (states) {
+        int state = __builtin_ctzll(states);
+        states &= states - 1;
+        if (state >= query->step_count) continue;
+
+        const QueryStep *step = &query->steps[state];
+        if (step->descendant) {
+            next |= (uint64_t)1 << state;
+        }
+        if (step_selects(step, key, key_len, ordinal)) {
+            next |= (uint64_t)1 << (state + 1);
+        }
+    }
+
+    return next;
+}
@@ -0,0 +1,100 @@
+#ifndef QUERY_H
+#define QUERY_H
+
+#include <regex.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "viewer.h"
+
+/* What can be typed at the search prompt:
+ *
+ *   text          case-insensitive substring of a key or value
+ *   re:PATTERN    POSIX extended regex, case-insensitive, against a key or
+ *                 value
+ *   $.a['b'][*]   path from the document root. Steps are .name, ['name'],
+ *                 [N] and [*] / .* for any member; ..name and ..* match at
+ *                 any depth below the previous step.
+ */
+typedef enum {
+    QUERY_TEXT,
+    QUERY_REGEX,
+    QUERY_PATH
+} QueryKind;
+
+/* Path automaton states are kept as a bitmask, one bit per step matched */
+#define QUERY_MAX_STEPS 63
+
+/* A search term prepared once per search, ASCII-folded to lower case */
+typedef struct {
+    char needle[MAX_SEARCH_LEN];
+    size_t len;
+} SearchPattern;
+
+typedef enum {
+    QUERY_STEP_NAME,        /* object member by key */
+    QUERY_STEP_INDEX,       /* array element by position */
+    QUERY_STEP_ANY          /* any member or element */
+} QueryStepSelector;
+
+typedef struct {
+    int descendant;         /* 1 for .., which may skip any number of levels */
+    QueryStepSelector selector;
+    const char *name;       /* points into Query.source, not NUL-terminated */
+    size_t name_len;
+    int index;
+} QueryStep;
+
+typedef struct {
+    QueryKind kind;
+    char source[MAX_SEARCH_LEN];    /* the term as typed */
+    SearchPattern pattern;          /* QUERY_TEXT */
+    const char *regex;              /* QUERY_REGEX, points into source */
+    QueryStep steps[QUERY_MAX_STEPS];
+    int step_count;                 /* QUERY_PATH */
+} Query;
+
+void search_compile(SearchPattern *pattern, const char *term);
+
+/* Case-insensitive search for the pattern inside a span of text that need
+ * not be NUL-terminated. Returns the first match or NULL. */
+const char *search_span(const SearchPattern *pattern, const char *text, size_t len);
+
+/* Parse a search term. Returns 0, or -1 with *error pointing to a short
+ * static description of what is wrong with it. */
+int query_compile(Query *query, const char *term, const char **error);
+
+/* Build the matcher of a regex query. Each thread needs its own, since
+ * glibc serialises regexec() calls on a shared regex_t. Returns 0 or -1. */
+int query_regcomp(const Query *query, regex_t *re);
+
+/* Check a key or value token against a text or regex query; re is the
+ * caller's matcher from query_regcomp(), unused for text */
+int query_match_token(const Query *query, const regex_t *re,
+                      const JsonViewer *viewer, int tok_idx);
+
+/* The same for a span of text that is no token, such as a key found
+ * without tokenizing its object */
+int query_match_span(const Query *query, const regex_t *re, const char *text, size_t len);
+
+/* Path queries are evaluated top-down in document order. A top-level value
+ * starts in QUERY_PATH_ROOT; every other token's states follow from its
+ * container's with query_path_step(), given its position among the
+ * container's members (keys not counted). A token matches when its states
+ * include query_path_accept(), and no token below a container whose states
+ * are empty can match. Object keys have no states of their own. */
+#define QUERY_PATH_ROOT ((uint64_t)1)
+
+uint64_t query_path_step(const Query *query, uint64_t states,
+                         const JsonViewer *viewer, int tok_idx, int ordinal);
+
+/* The same for a member given by its key, without quotes, or for an array
+ * element by NULL */
+uint64_t query_path_member(const Query *query, uint64_t states,
+                           const char *key, size_t key_len, int ordinal);
+
+static inline uint64_t query_path_accept(const Query *query) {
+    return (uint64_t)1 << query->step_count;
+}
+
+#endif /* QUERY_H */
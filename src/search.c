@@ -0,0 +1,774 @@
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bitset.h"
+#include "ndjson.h"
+#include "search.h"
+#include "stats.h"
+
+/* Tokens of bitset word w that may match: the cached hits of a shorter
+ * term, and every token that term never saw. Tokens before job->from are
+ * already searched. */
+static inline uint64_t candidate_mask(const SearchJob *job, int w) {
+    int known = job->candidate_tokens;
+    uint64_t mask = ~(uint64_t)0;
+
+    if (job->candidates && w < known >> 6) {
+        mask = job->candidates[w];
+    } else if (job->candidates && w == known >> 6 && (known & 63)) {
+        mask = job->candidates[w] | (~(uint64_t)0 << (known & 63));
+    }
+    if (w == job->from >> 6 && (job->from & 63)) {
+        mask &= ~(uint64_t)0 << (job->from & 63);
+    }
+    return mask;
+}
+
+/* Add a finished bitset word in one go, so the UI may read the bitset while
+ * the workers are running, and account for its matches. The word holds no
+ * matches but those of tokens before job->from yet. */
+static void publish_word(SearchWorker *worker, int w, uint64_t word, int matches) {
+    JsonViewer *viewer = worker->job->viewer;
+
+    __atomic_fetch_or(&viewer->search_matches[w], word, __ATOMIC_RELAXED);
+    if (atomic_load_explicit(&worker->first, memory_order_relaxed) < 0) {
+        atomic_store(&worker->first, (w << 6) + __builtin_ctzll(word));
+    }
+    atomic_fetch_add(&worker->count, matches);
+}
+
+/* Test the tokens of one slice against a text or regex query, a bitset
+ * word at a time */
+static void search_scan(SearchWorker *worker) {
+    SearchJob *job = worker->job;
+
+    for (int base = worker->begin; base < worker->end; base += 64) {
+        if (atomic_load_explicit(&job->cancel, memory_order_relaxed)) break;
+
+        uint64_t want = candidate_mask(job, base >> 6);
+        uint64_t word = 0;
+
+        if (worker->end - base < 64) {
+            want &= ~(~(uint64_t)0 << (worker->end - base));
+        }
+
+        while (want) {
+            int bit = __builtin_ctzll(want);
+            if (query_match_token(&job->query, &worker->re, job->viewer, base + bit)) {
+                word |= (uint64_t)1 << bit;
+            }
+            want &= want - 1;
+        }
+
+        if (word) publish_word(worker, base >> 6, word, __builtin_popcountll(word));
+    }
+}
+
+/* The containers enclosing the current token during a path walk, with
+ * their automaton states and the members seen so far; kept from one walk
+ * to the next */
+typedef struct {
+    int *open;
+    uint64_t *states;
+    int *members;
+    int capacity;
+} PathStack;
+
+/* Evaluate a path query in one pass over the tokens [0, count) of a
+ * document, whose top-level values start in the states root, handing
+ * every match to emit in document order. The automaton states of the
+ * enclosing containers ride on a stack, and every subtree that can no
+ * longer lead to a match is skipped whole using the structural index. */
+static void path_walk(PathStack *stack, const Query *query, const JsonViewer *doc, uint64_t root,
+                      int count, atomic_int *cancel, SearchEmit emit, void *ctx) {
+    uint64_t accept = query_path_accept(query);
+    int depth = 0;
+
+    for (int tok = 0; tok < count;) {
+        if ((tok & 1023) == 0 && cancel && atomic_load_explicit(cancel, memory_order_relaxed)) break;
+
+        // Keys only label the values that follow them
+        if (is_object_key(&doc->index, tok)) {
+            tok++;
+            continue;
+        }
+
+        int parent = doc->index.parents[tok];
+        while (depth > 0 && stack->open[depth - 1] != parent) depth--;
+
+        uint64_t states = root;
+        if (parent >= 0) {
+            // Siblings are visited in order even when their subtrees are
+            // skipped, so counting them gives each one its position
+            states = depth > 0 ? query_path_step(query, stack->states[depth - 1], doc, tok,
+                                                 stack->members[depth - 1]++) : 0;
+        }
+
+        if (states & accept) emit(ctx, tok);
+
+        if (!(states & (accept - 1)) || !is_container(&doc->index, tok)) {
+            int next = skip_token(&doc->index, tok);
+            tok = next > tok ? next : tok + 1;
+            continue;
+        }
+
+        if (depth == stack->capacity) {
+            int new_capacity = stack->capacity ? stack->capacity * 2 : 64;
+            int *grown_open = realloc(stack->open, sizeof(int) * new_capacity);
+            if (grown_open) stack->open = grown_open;
+            uint64_t *grown_states = realloc(stack->states, sizeof(uint64_t) * new_capacity);
+            if (grown_states) stack->states = grown_states;
+            int *grown_members = realloc(stack->members, sizeof(int) * new_capacity);
+            if (grown_members) stack->members = grown_members;
+            if (!grown_open || !grown_states || !grown_members) break;
+            stack->capacity = new_capacity;
+        }
+        stack->open[depth] = tok;
+        stack->states[depth] = states;
+        stack->members[depth] = 0;
+        depth++;
+        tok++;
+    }
+}
+
+static void path_stack_free(PathStack *stack) {
+    free(stack->open);
+    free(stack->states);
+    free(stack->members);
+}
+
+/* Path matches of the whole token array, gathered into bitset words */
+typedef struct {
+    SearchWorker *worker;
+    int word_idx;
+    uint64_t word;
+} WordSink;
+
+static void emit_word(void *ctx, int tok_idx) {
+    WordSink *sink = ctx;
+
+    if (sink->word && (tok_idx >> 6) != sink->word_idx) {
+        publish_word(sink->worker, sink->word_idx, sink->word, __builtin_popcountll(sink->word));
+        sink->word = 0;
+    }
+    sink->word_idx = tok_idx >> 6;
+    sink->word |= (uint64_t)1 << (tok_idx & 63);
+}
+
+static void search_path(SearchWorker *worker) {
+    SearchJob *job = worker->job;
+    PathStack stack = { NULL, NULL, NULL, 0 };
+    WordSink sink = { worker, 0, 0 };
+
+    path_walk(&stack, &job->query, job->viewer, QUERY_PATH_ROOT, job->token_count, &job->cancel,
+              emit_word, &sink);
+    if (sink.word) {
+        publish_word(worker, sink.word_idx, sink.word, __builtin_popcountll(sink.word));
+    }
+
+    path_stack_free(&stack);
+}
+
+/* Matches inside one small document, counted and optionally marked */
+typedef struct {
+    uint64_t *marks;
+    int count;
+} MarkSink;
+
+static void emit_mark(void *ctx, int tok_idx) {
+    MarkSink *sink = ctx;
+
+    if (sink->marks) bitset_set(sink->marks, tok_idx);
+    sink->count++;
+}
+
+static void match_each(const Query *query, const regex_t *re, PathStack *stack,
+                       const JsonViewer *doc, uint64_t root, SearchEmit emit, void *ctx) {
+    if (query->kind == QUERY_PATH) {
+        path_walk(stack, query, doc, root, doc->token_count, NULL, emit, ctx);
+        return;
+    }
+
+    for (int tok = 0; tok < doc->token_count; tok++) {
+        if (query_match_token(query, re, doc, tok)) emit(ctx, tok);
+    }
+}
+
+/* Count, and optionally mark, the matches in one parsed record whose value
+ * starts in the path states root. A skeleton record's key is none of its
+ * tokens, so a match on it is marked on the value it names. */
+static int match_record(const Query *query, const regex_t *re, PathStack *stack,
+                        const JsonViewer *viewer, int record, const JsonViewer *doc,
+                        uint64_t root, uint64_t *marks) {
+    MarkSink sink = { marks, 0 };
+
+    if (doc->token_count > 0 && search_record_key(query, re, viewer, record)) {
+        emit_mark(&sink, 0);
+    }
+    match_each(query, re, stack, doc, root, emit_mark, &sink);
+    return sink.count;
+}
+
+void search_each(const Query *query, const regex_t *re, const JsonViewer *doc, uint64_t root,
+                 SearchEmit emit, void *ctx) {
+    PathStack stack = { NULL, NULL, NULL, 0 };
+
+    match_each(query, re, &stack, doc, root, emit, ctx);
+    path_stack_free(&stack);
+}
+
+uint64_t search_record_root(const Query *query, const JsonViewer *viewer, int record) {
+    if (query->kind != QUERY_PATH || !viewer->ndjson->skeleton) return QUERY_PATH_ROOT;
+    if (!viewer->ndjson->keyed) return query_path_member(query, QUERY_PATH_ROOT, NULL, 0, record);
+
+    // The key comes with its quotes
+    size_t len;
+    const char *key = ndjson_record_key(viewer, record, &len);
+    return key ? query_path_member(query, QUERY_PATH_ROOT, key + 1, len - 2, record) : 0;
+}
+
+int search_record_key(const Query *query, const regex_t *re, const JsonViewer *viewer, int record) {
+    size_t len;
+    const char *key = query->kind != QUERY_PATH ? ndjson_record_key(viewer, record, &len) : NULL;
+    return key && query_match_span(query, re, key + 1, len - 2);
+}
+
+/* Test the records of one slice of a JSON Lines document, parsing each
+ * into scratch space. A record's bit is set when any of its tokens match,
+ * and the count covers every matching token. */
+static void search_records(SearchWorker *worker) {
+    SearchJob *job = worker->job;
+    NdjsonScratch scratch;
+    PathStack stack = { NULL, NULL, NULL, 0 };
+
+    ndjson_scratch_init(&scratch);
+
+    for (int base = worker->begin; base < worker->end; base += 64) {
+        if (atomic_load_explicit(&job->cancel, memory_order_relaxed)) break;
+
+        uint64_t want = candidate_mask(job, base >> 6);
+        uint64_t word = 0;
+        int matches = 0;
+
+        if (worker->end - base < 64) {
+            want &= ~(~(uint64_t)0 << (worker->end - base));
+        }
+
+        while (want) {
+            int bit = __builtin_ctzll(want);
+            // A path that leads elsewhere spares parsing the record at all
+            uint64_t root = search_record_root(&job->query, job->viewer, base + bit);
+            if (root && ndjson_scratch_parse(&scratch, job->viewer, base + bit) >= 0) {
+                int found = match_record(&job->query, &worker->re, &stack, job->viewer,
+                                         base + bit, &scratch.doc, root, NULL);
+                if (found) {
+                    word |= (uint64_t)1 << bit;
+                    matches += found;
+                }
+            }
+            want &= want - 1;
+        }
+
+        if (word) publish_word(worker, base >> 6, word, matches);
+    }
+
+    ndjson_scratch_free(&scratch);
+    path_stack_free(&stack);
+}
+
+static void *search_worker(void *arg) {
+    SearchWorker *worker = arg;
+
+    if (worker->job->viewer->ndjson) {
+        search_records(worker);
+    } else if (worker->job->query.kind == QUERY_PATH) {
+        search_path(worker);
+    } else {
+        search_scan(worker);
+    }
+
+    atomic_store(&worker->done, 1);
+    return NULL;
+}
+
+/* Expand whatever hides a match and move the cursor onto its line. Only
+ * the collapsed ancestors of the match are opened. */
+static void reveal_match(JsonViewer *viewer, int tok_idx) {
+    // A value drawn next to its key lives on the line of the key, which
+    // is always the token right before it
+    if (is_inline_value(&viewer->index, tok_idx)) {
+        tok_idx--;
+    }
+
+    // Going up from the innermost ancestor, every expand but the one on the
+    // outermost collapsed (and still shown) container only clears a flag;
+    // that last one splices the whole revealed chain in at once
+    for (int p = viewer->index.parents[tok_idx]; p >= 0; p = viewer->index.parents[p]) {
+        if (bitset_test(viewer->collapsed, p)) {
+            set_collapsed(viewer, p, 0);
+        }
+    }
+
+    viewer->current_line = visible_lines_line(&viewer->lines, tok_idx);
+}
+
+/* Number of bits in the match bitset: records of a JSON Lines document,
+ * tokens otherwise */
+static int search_units(const JsonViewer *viewer) {
+    return viewer->ndjson ? viewer->ndjson->count : viewer->token_count;
+}
+
+/* In a JSON Lines document the current match is token
+ * doc->current_match_tok of record viewer->current_match_tok */
+static void reveal_record_match(JsonViewer *viewer, int record, JsonViewer *doc, int tok_idx) {
+    viewer->current_match_tok = record;
+    doc->current_match_tok = tok_idx;
+    reveal_match(doc, tok_idx);
+    ndjson_relayout(viewer, record);
+
+    viewer->current_line = ndjson_record_line(viewer, record) + doc->current_line;
+}
+
+/* Make the first match of a unit the current one */
+static void reveal_first(JsonViewer *viewer, int unit) {
+    if (!viewer->ndjson) {
+        viewer->current_match_tok = unit;
+        reveal_match(viewer, unit);
+        return;
+    }
+
+    JsonViewer *doc = ndjson_record(viewer, unit);
+    int tok_idx = doc ? bitset_next(doc->search_matches, 0, doc->token_count) : -1;
+    if (tok_idx >= 0) {
+        reveal_record_match(viewer, unit, doc, tok_idx);
+    }
+}
+
+/* Step to the next or previous match of a JSON Lines document: within the
+ * current record while it has more, else into the next matching record */
+static void step_record_match(JsonViewer *viewer, int forward) {
+    int records = viewer->ndjson->count;
+    int record = viewer->current_match_tok;
+    JsonViewer *doc = record >= 0 ? ndjson_record(viewer, record) : NULL;
+    int had_match = doc && doc->current_match_tok >= 0;
+    int wrapped = 0;
+    int tok_idx = -1;
+
+    if (doc) {
+        tok_idx = forward ? bitset_next(doc->search_matches, doc->current_match_tok + 1, doc->token_count)
+                          : bitset_prev(doc->search_matches, doc->current_match_tok - 1);
+    }
+
+    if (tok_idx < 0) {
+        record = forward ? bitset_next(viewer->search_matches, record + 1, records)
+                         : bitset_prev(viewer->search_matches, record - 1);
+        if (record < 0) {
+            record = forward ? bitset_next(viewer->search_matches, 0, records)
+                             : bitset_prev(viewer->search_matches, records - 1);
+            wrapped = 1;
+        }
+
+        doc = record >= 0 ? ndjson_record(viewer, record) : NULL;
+        if (!doc) return;
+        tok_idx = forward ? bitset_next(doc->search_matches, 0, doc->token_count)
+                          : bitset_prev(doc->search_matches, doc->token_count - 1);
+        if (tok_idx < 0) return;
+    }
+
+    if (forward) {
+        viewer->current_match_idx = wrapped ? 0 : viewer->current_match_idx + had_match;
+    } else {
+        viewer->current_match_idx = wrapped ? viewer->search_match_count - 1
+                                            : viewer->current_match_idx - 1;
+    }
+    reveal_record_match(viewer, record, doc, tok_idx);
+}
+
+void search_record(JsonViewer *viewer, int record, JsonViewer *doc) {
+    Query query;
+    regex_t re;
+    const char *error;
+
+    memset(doc->search_matches, 0, sizeof(uint64_t) * BITSET_WORDS(doc->token_count));
+    doc->search_match_count = 0;
+    doc->current_match_tok = -1;
+
+    if (!viewer->search_term[0] || query_compile(&query, viewer->search_term, &error) < 0) return;
+    if (query.kind == QUERY_REGEX && query_regcomp(&query, &re) < 0) return;
+
+    PathStack stack = { NULL, NULL, NULL, 0 };
+    doc->search_match_count = match_record(&query, &re, &stack, viewer, record, doc,
+                                           search_record_root(&query, viewer, record),
+                                           doc->search_matches);
+    path_stack_free(&stack);
+
+    if (query.kind == QUERY_REGEX) regfree(&re);
+}
+
+void search_cache_init(SearchCache *cache) {
+    cache->count = 0;
+}
+
+/* Newest cached result that a query can start from: the longest cached
+ * prefix of a text term, or the very same regex or path query */
+static SearchCacheEntry *search_cache_lookup(SearchCache *cache, const Query *query) {
+    SearchCacheEntry *best = NULL;
+
+    for (int i = 0; i < cache->count; i++) {
+        SearchCacheEntry *entry = &cache->entries[i];
+        const SearchPattern *cached = &entry->pattern;
+
+        if (entry->kind != query->kind) continue;
+
+        if (query->kind != QUERY_TEXT) {
+            if (strcmp(entry->source, query->source) == 0) best = entry;
+        } else if (cached->len <= query->pattern.len &&
+                   (!best || cached->len >= best->pattern.len) &&
+                   memcmp(cached->needle, query->pattern.needle, cached->len) == 0) {
+            best = entry;
+        }
+    }
+    return best;
+}
+
+/* Remember the result of a finished search */
+static void search_cache_store(SearchCache *cache, JsonViewer *viewer, const SearchJob *job) {
+    size_t bytes = sizeof(uint64_t) * BITSET_WORDS(job->token_count);
+    uint64_t *matches = malloc(bytes ? bytes : 1);
+    if (!matches) return;
+    memcpy(matches, viewer->search_matches, bytes);
+
+    if (cache->count == SEARCH_CACHE_LEVELS) {
+        free(cache->entries[0].matches);
+        memmove(&cache->entries[0], &cache->entries[1],
+                sizeof(SearchCacheEntry) * (SEARCH_CACHE_LEVELS - 1));
+        cache->count--;
+    }
+
+    SearchCacheEntry *entry = &cache->entries[cache->count++];
+    entry->kind = job->query.kind;
+    memcpy(entry->source, job->query.source, sizeof(entry->source));
+    entry->pattern = job->query.pattern;
+    entry->matches = matches;
+    entry->token_count = job->token_count;
+    entry->count = viewer->search_match_count;
+}
+
+void search_cache_free(JsonViewer *viewer, SearchCache *cache) {
+    SearchJob *job = viewer->search;
+
+    if (job && job->cache == cache) {
+        job->cache = NULL;
+    }
+
+    for (int i = 0; i < cache->count; i++) {
+        // A narrowing search may still be reading its candidates
+        if (job && cache->entries[i].matches == job->candidates) {
+            job->owned_candidates = cache->entries[i].matches;
+        } else {
+            free(cache->entries[i].matches);
+        }
+    }
+    cache->count = 0;
+}
+
+static int online_cpus(void) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) return 1;
+    return cpus > SEARCH_MAX_THREADS ? SEARCH_MAX_THREADS : (int)cpus;
+}
+
+/* Join the workers and let the loader continue */
+static void search_finish(JsonViewer *viewer) {
+    SearchJob *job = viewer->search;
+
+    for (int i = 0; i < job->thread_count; i++) {
+        pthread_join(job->workers[i].thread, NULL);
+    }
+    if (job->query.kind == QUERY_REGEX) {
+        for (int i = 0; i < job->worker_count; i++) {
+            regfree(&job->workers[i].re);
+        }
+    }
+
+    // Every word a worker stored is in its count, even when cancelled
+    viewer->search_match_count = job->from_count;
+    for (int i = 0; i < job->worker_count; i++) {
+        viewer->search_match_count += atomic_load(&job->workers[i].count);
+    }
+
+    if (!atomic_load(&job->cancel)) {
+        viewer->search_covered = job->token_count;
+        if (job->cache) search_cache_store(job->cache, viewer, job);
+    }
+
+    // The current match keeps its place in the numbering. Matches per
+    // record are not kept, so a JSON Lines count carries on as stepped.
+    if (!viewer->ndjson) {
+        viewer->current_match_idx = bitset_count(viewer->search_matches,
+                                                 viewer->current_match_tok);
+    }
+
+    stats_add(STATS_SEARCH, job->started);
+    free(job->owned_candidates);
+    FREE_PTR(viewer->search);
+    pthread_cond_broadcast(&viewer->search_idle);
+}
+
+/* Split the units from job->from on between workers and set them going */
+static int search_launch(JsonViewer *viewer, SearchJob *job) {
+    // Slices start on bitset word boundaries so no two workers share a
+    // word. A path query over one document is a single top-down pass;
+    // records are all walked from their own root.
+    int per_thread = viewer->ndjson ? SEARCH_MIN_RECORDS_PER_THREAD : SEARCH_MIN_TOKENS_PER_THREAD;
+    int first_word = job->from >> 6;
+    int words = (int)BITSET_WORDS(job->token_count) - first_word;
+    int workers = (job->token_count - job->from) / per_thread;
+    int cpus = online_cpus();
+    if (workers > cpus) workers = cpus;
+    if (workers < 1 || (job->query.kind == QUERY_PATH && !viewer->ndjson)) workers = 1;
+
+    if (job->query.kind == QUERY_REGEX) {
+        for (int i = 0; i < workers; i++) {
+            if (query_regcomp(&job->query, &job->workers[i].re) < 0) {
+                while (--i >= 0) regfree(&job->workers[i].re);
+                free(job->owned_candidates);
+                free(job);
+                return -1;
+            }
+        }
+    }
+
+    for (int i = 0; i < workers; i++) {
+        SearchWorker *worker = &job->workers[i];
+        worker->job = job;
+        worker->begin = (first_word + (int)((long long)words * i / workers)) * 64;
+        worker->end = (first_word + (int)((long long)words * (i + 1) / workers)) * 64;
+        if (worker->end > job->token_count) worker->end = job->token_count;
+        atomic_init(&worker->first, -1);
+        atomic_init(&worker->count, 0);
+        atomic_init(&worker->done, 0);
+    }
+    job->worker_count = workers;
+    viewer->search = job;
+
+    // Small documents, and any slices that could not get a thread, are
+    // searched right here
+    if (job->token_count - job->from >= per_thread) {
+        while (job->thread_count < workers &&
+               pthread_create(&job->workers[job->thread_count].thread, NULL,
+                              search_worker, &job->workers[job->thread_count]) == 0) {
+            job->thread_count++;
+        }
+    }
+    for (int i = job->thread_count; i < workers; i++) {
+        search_worker(&job->workers[i]);
+    }
+
+    search_poll(viewer);
+    return 0;
+}
+
+int search_start(JsonViewer *viewer, SearchCache *cache) {
+    search_cancel(viewer);
+
+    int units = search_units(viewer);
+
+    memset(viewer->search_matches, 0, sizeof(uint64_t) * BITSET_WORDS(units));
+    viewer->search_match_count = 0;
+    viewer->search_covered = -1;
+    viewer->current_match_idx = 0;
+    viewer->current_match_tok = -1;
+    viewer->search_error = NULL;
+
+    if (!viewer->search_term[0]) return 0;
+
+    SearchJob *job = calloc(1, sizeof(SearchJob));
+    if (!job) return -1;
+
+    if (query_compile(&job->query, viewer->search_term, &viewer->search_error) < 0) {
+        free(job);
+        return -1;
+    }
+
+    // Records already parsed for display are small, and marked right away
+    if (viewer->ndjson) {
+        for (int i = 0; i < viewer->ndjson->parsed_count; i++) {
+            if (viewer->ndjson->parsed[i].doc) {
+                search_record(viewer, viewer->ndjson->parsed[i].record,
+                              viewer->ndjson->parsed[i].doc);
+            }
+        }
+    }
+
+    SearchCacheEntry *cached = cache ? search_cache_lookup(cache, &job->query) : NULL;
+    int same = cached && (job->query.kind != QUERY_TEXT ||
+                          cached->pattern.len == job->query.pattern.len);
+
+    // The same query over the same tokens needs no search at all
+    if (same && cached->token_count == units) {
+        free(job);
+        memcpy(viewer->search_matches, cached->matches,
+               sizeof(uint64_t) * BITSET_WORDS(cached->token_count));
+        viewer->search_match_count = cached->count;
+        viewer->search_covered = units;
+        int first = bitset_next(viewer->search_matches, 0, units);
+        if (first >= 0) {
+            reveal_first(viewer, first);
+        }
+        return 0;
+    }
+
+    job->viewer = viewer;
+    job->started = stats_now();
+    job->token_count = units;
+    job->jump = 1;
+    job->cache = cache;
+    if (cached && job->query.kind != QUERY_PATH) {
+        job->candidates = cached->matches;
+        job->candidate_tokens = cached->token_count;
+    }
+    atomic_init(&job->cancel, 0);
+
+    return search_launch(viewer, job);
+}
+
+/* Carry the finished search over the units loaded since. Only the new ones
+ * are tested and the cursor stays where it is; a path query over a single
+ * document walks it from the root again. */
+static int search_extend(JsonViewer *viewer) {
+    int units = search_units(viewer);
+    int from = viewer->search_covered;
+
+    if (viewer->search || !viewer->search_term[0] || from < 0 || from >= units) return 0;
+
+    SearchJob *job = calloc(1, sizeof(SearchJob));
+    if (!job) return -1;
+    if (query_compile(&job->query, viewer->search_term, &viewer->search_error) < 0) {
+        free(job);
+        return -1;
+    }
+    if (job->query.kind == QUERY_PATH && !viewer->ndjson) {
+        from = 0;
+        viewer->search_match_count = 0;
+    }
+
+    // Nothing past the units searched so far can be marked yet, but a
+    // word is only ever added to
+    if (from & 63) {
+        viewer->search_matches[from >> 6] &= ~(~(uint64_t)0 << (from & 63));
+    }
+    size_t first_clear = BITSET_WORDS(from);
+    memset(&viewer->search_matches[first_clear], 0,
+           sizeof(uint64_t) * (BITSET_WORDS(units) - first_clear));
+
+    job->viewer = viewer;
+    job->started = stats_now();
+    job->token_count = units;
+    job->from = from;
+    job->from_count = viewer->search_match_count;
+    // A term that had no match yet still goes to the first one it gets
+    job->jump = job->from_count == 0;
+    atomic_init(&job->cancel, 0);
+
+    return search_launch(viewer, job);
+}
+
+int search_poll(JsonViewer *viewer) {
+    if (!viewer->search && search_extend(viewer) < 0) return 0;
+
+    SearchJob *job = viewer->search;
+    if (!job) return 0;
+
+    int count = job->from_count;
+    int done = 1;
+    int first = -1;
+
+    // The first match is settled once every slice before it is finished
+    for (int i = 0; i < job->worker_count; i++) {
+        SearchWorker *worker = &job->workers[i];
+        int worker_first = atomic_load(&worker->first);
+
+        if (first < 0 && done && worker_first >= 0) {
+            first = worker_first;
+        }
+        count += atomic_load(&worker->count);
+        done = done && atomic_load(&worker->done);
+    }
+    viewer->search_match_count = count;
+
+    if (job->jump && first >= 0) {
+        job->jump = 0;
+        reveal_first(viewer, first);
+    }
+
+    if (!done) return 1;
+
+    search_finish(viewer);
+    return 0;
+}
+
+void search_cancel(JsonViewer *viewer) {
+    if (!viewer->search) return;
+
+    atomic_store(&viewer->search->cancel, 1);
+    search_finish(viewer);
+}
+
+void search_wait(JsonViewer *viewer) {
+    if (!viewer->search) return;
+
+    search_finish(viewer);
+}
+
+/* Go to next search match */
+void goto_next_match(JsonViewer *viewer) {
+    if (viewer->search_match_count == 0) return;
+
+    // Stepping by hand overrides the jump to the first match
+    if (viewer->search) viewer->search->jump = 0;
+
+    if (viewer->ndjson) {
+        step_record_match(viewer, 1);
+        return;
+    }
+
+    int from = viewer->current_match_tok;
+    int tok_idx = bitset_next(viewer->search_matches, from + 1, viewer->token_count);
+
+    if (tok_idx < 0) {
+        tok_idx = bitset_next(viewer->search_matches, 0, viewer->token_count);
+        viewer->current_match_idx = 0;
+    } else if (from >= 0 && bitset_test(viewer->search_matches, from)) {
+        viewer->current_match_idx++;
+    }
+
+    viewer->current_match_tok = tok_idx;
+    reveal_match(viewer, tok_idx);
+}
+
+/* Go to previous search match */
+void goto_prev_match(JsonViewer *viewer) {
+    if (viewer->search_match_count == 0) return;
+
+    // Stepping by hand overrides the jump to the first match
+    if (viewer->search) viewer->search->jump = 0;
+
+    if (viewer->ndjson) {
+        step_record_match(viewer, 0);
+        return;
+    }
+
+    int tok_idx = bitset_prev(viewer->search_matches, viewer->current_match_tok - 1);
+
+    if (tok_idx < 0) {
+        tok_idx = bitset_prev(viewer->search_matches, viewer->token_count - 1);
+        viewer->current_match_idx = viewer->search_match_count - 1;
+    } else {
+        viewer->current_match_idx--;
+    }
+
+    viewer->current_match_tok = tok_idx;
+    reveal_match(viewer, tok_idx);
+}
@@ -0,0 +1,139 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+#include "query.h"
+#include "viewer.h"
+
+/* Upper bound on worker threads per search */
+#define SEARCH_MAX_THREADS 64
+/* Fewer tokens than this per worker are not worth a thread; documents
+ * below it are searched inline, larger ones always off the UI thread */
+#define SEARCH_MIN_TOKENS_PER_THREAD (1 << 16)
+/* The same for JSON Lines records, each of which is parsed first */
+#define SEARCH_MIN_RECORDS_PER_THREAD (1 << 10)
+/* Results remembered while a search term is being typed */
+#define SEARCH_CACHE_LEVELS 16
+
+/* The matches of one finished search, kept while the term is being edited.
+ * Only what identifies the query is kept, since the rest of a Query
+ * points into its own source. */
+typedef struct {
+    QueryKind kind;
+    char source[MAX_SEARCH_LEN];
+    SearchPattern pattern;  /* QUERY_TEXT */
+    uint64_t *matches;      /* bitset over token_count tokens */
+    int token_count;
+    int count;
+} SearchCacheEntry;
+
+/* Every token matching a text term also matches each prefix of it, so a
+ * search for a longer term only has to recheck the hits of a cached prefix
+ * (plus any tokens loaded since), and deleting a character brings back an
+ * earlier result as is. Regex and path queries are only reused verbatim.
+ * The oldest entry is dropped once all are used. */
+typedef struct {
+    SearchCacheEntry entries[SEARCH_CACHE_LEVELS];
+    int count;
+} SearchCache;
+
+/* One contiguous, 64-token aligned slice of the token array. Each worker
+ * owns the bitset words of its slice, so results need no merging beyond
+ * summing the counts in order. */
+typedef struct {
+    struct SearchJob *job;
+    int begin, end;
+    atomic_int first;       /* earliest match in the slice, or -1 */
+    atomic_int count;       /* matches found so far */
+    atomic_int done;
+    pthread_t thread;
+    regex_t re;             /* private matcher for regex queries */
+} SearchWorker;
+
+typedef struct SearchJob {
+    JsonViewer *viewer;
+    Query query;
+    int token_count;        /* tokens searched; the loader waits meanwhile */
+    int from;               /* tokens before it were searched before */
+    int from_count;         /* and hold this many matches */
+    int jump;               /* move the cursor to the first match once known */
+    long long started;      /* stats_now() when the search began */
+    atomic_int cancel;
+    SearchCache *cache;     /* receives the result, may be NULL */
+    const uint64_t *candidates;     /* only these tokens can match, or NULL */
+    int candidate_tokens;           /* tokens covered by candidates */
+    uint64_t *owned_candidates;     /* candidates taken over from a freed cache */
+    int worker_count;
+    int thread_count;       /* workers [0, thread_count) run on threads */
+    SearchWorker workers[SEARCH_MAX_THREADS];
+} SearchJob;
+
+/* Mark every token that matches the query in viewer->search_term in
+ * viewer->search_matches, whether it is shown, collapsed away or drawn
+ * inline next to its key. Text and regex queries on large documents are
+ * split across worker threads, and a path query gets a thread of its own
+ * for its single pass; the call then returns right away, leaving the job
+ * in viewer->search; small ones are finished before returning. The cursor
+ * moves to the first match as soon as it is known. With a cache, the
+ * search narrows down a cached result where it can and adds its own result
+ * once done. Call with viewer->lock held. Returns 0, or -1 if out of memory
+ * or the query does not parse, in which case viewer->search_error says
+ * why. */
+int search_start(JsonViewer *viewer, SearchCache *cache);
+
+void search_cache_init(SearchCache *cache);
+
+/* Drop every cached result. An in-flight search keeps running but no
+ * longer reports to the cache. */
+void search_cache_free(JsonViewer *viewer, SearchCache *cache);
+
+/* Publish the progress of an in-flight search: the running match count and
+ * the first match. Reaps the workers once they are all done. Without one,
+ * starts searching whatever the loader added since the last search ended.
+ * Returns 1 while the search is still running. */
+int search_poll(JsonViewer *viewer);
+
+/* Stop an in-flight search and wait for its workers. The matches found so
+ * far stay marked. */
+void search_cancel(JsonViewer *viewer);
+
+/* Let an in-flight search run to the end and reap its workers, for
+ * callers with nothing else to do meanwhile */
+void search_wait(JsonViewer *viewer);
+
+typedef void (*SearchEmit)(void *ctx, int tok_idx);
+
+/* Hand every token of a parsed document that matches the query to emit,
+ * in document order, on the calling thread. Top-level values start in the
+ * path states root, QUERY_PATH_ROOT for a document of its own. re is the
+ * caller's matcher from query_regcomp(), unused for text and path
+ * queries. */
+void search_each(const Query *query, const regex_t *re, const JsonViewer *doc, uint64_t root,
+                 SearchEmit emit, void *ctx);
+
+/* Path states the value of a record starts in. A JSON Lines record is a
+ * document of its own; a skeleton mode record is a member of the
+ * document's container, reached through its key or its position. Returns
+ * 0 if the query cannot match inside the record, which then need not be
+ * parsed. */
+uint64_t search_record_root(const Query *query, const JsonViewer *viewer, int record);
+
+/* Whether a text or regex query matches the key of a skeleton mode record,
+ * which is not among the record's own tokens */
+int search_record_key(const Query *query, const regex_t *re, const JsonViewer *viewer, int record);
+
+/* Mark the matches of viewer->search_term inside one parsed record of a
+ * JSON Lines document, in doc->search_matches; a match on its key marks
+ * its value. A search of the whole document only flags the records that
+ * match, one bit each. */
+void search_record(JsonViewer *viewer, int record, JsonViewer *doc);
+
+/* Move the cursor to the next/previous match, wrapping around, and expand
+ * the containers hiding it */
+void goto_next_match(JsonViewer *viewer);
+void goto_prev_match(JsonViewer *viewer);
+
+#endif /* SEARCH_H */
@@ -0,0 +1,107 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ndjson.h"
+#include "stats.h"
+
+static const char *const phase_names[STATS_PHASES] = {
+    "read", "jsmn_parse", "index", "visible lines", "search", "render"
+};
+
+static struct {
+    atomic_llong ns[STATS_PHASES];
+    atomic_int calls[STATS_PHASES];
+    long long latencies[STATS_MAX_SAMPLES];     /* UI thread only */
+    int latency_count;                          /* samples ever taken */
+} stats;
+
+long long stats_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void stats_add(StatsPhase phase, long long start) {
+    atomic_fetch_add_explicit(&stats.ns[phase], stats_now() - start, memory_order_relaxed);
+    atomic_fetch_add_explicit(&stats.calls[phase], 1, memory_order_relaxed);
+}
+
+void stats_latency(long long start) {
+    stats.latencies[stats.latency_count % STATS_MAX_SAMPLES] = stats_now() - start;
+    stats.latency_count++;
+}
+
+static int compare_ns(const void *a, const void *b) {
+    long long x = *(const long long *)a;
+    long long y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+/* Resident and peak resident set size in kB, or -1 where /proc has none */
+static void rss_kb(long *current, long *peak) {
+    FILE *f = fopen("/proc/self/status", "r");
+    char line[256];
+
+    *current = *peak = -1;
+    while (f && fgets(line, sizeof(line), f)) {
+        sscanf(line, "VmRSS: %ld kB", current);
+        sscanf(line, "VmHWM: %ld kB", peak);
+    }
+    if (f) fclose(f);
+}
+
+int stats_report(JsonViewer *viewer, char lines[][STATS_LINE_MAX], int max_lines) {
+    int n = 0;
+
+#define LINE(...) \
+    do { if (n < max_lines) snprintf(lines[n++], STATS_LINE_MAX, __VA_ARGS__); } while (0)
+
+    LINE("%-14s %10s %8s", "phase", "total ms", "calls");
+    for (int i = 0; i < STATS_PHASES; i++) {
+        LINE("%-14s %10.1f %8d", phase_names[i],
+             atomic_load(&stats.ns[i]) / 1e6, atomic_load(&stats.calls[i]));
+    }
+
+    int samples = stats.latency_count < STATS_MAX_SAMPLES ? stats.latency_count : STATS_MAX_SAMPLES;
+    if (samples > 0) {
+        long long *sorted = malloc(sizeof(long long) * samples);
+        if (sorted) {
+            memcpy(sorted, stats.latencies, sizeof(long long) * samples);
+            qsort(sorted, samples, sizeof(long long), compare_ns);
+            LINE("key to paint   p50 %.2f ms  p99 %.2f ms", sorted[samples / 2] / 1e6,
+                 sorted[(samples * 99) / 100] / 1e6);
+            LINE("               max %.2f ms  %d keys", sorted[samples - 1] / 1e6,
+                 stats.latency_count);
+            free(sorted);
+        }
+    }
+
+    if (viewer->ndjson) {
+        LINE("%-14s %10d", "records", viewer->ndjson->count);
+    } else {
+        LINE("%-14s %10d", "tokens", viewer->token_count);
+    }
+
+    ViewerUsage usage[VIEWER_MAX_USAGE];
+    int count = viewer_usage(viewer, usage);
+    size_t total = 0;
+    LINE("%-14s %10s", "memory", "MB");
+    for (int i = 0; i < count; i++) {
+        LINE("  %-12s %10.1f", usage[i].name, usage[i].bytes / 1048576.0);
+        total += usage[i].bytes;
+    }
+    LINE("  %-12s %10.1f", "total", total / 1048576.0);
+    LINE("  %-12s %10.1f", "reserved", viewer->arena.size / 1048576.0);
+
+    long rss, peak;
+    rss_kb(&rss, &peak);
+    if (rss >= 0) {
+        LINE("%-14s %10.1f  peak %.1f", "RSS MB", rss / 1024.0, peak / 1024.0);
+    }
+
+#undef LINE
+    return n;
+}
@@ -0,0 +1,39 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "viewer.h"
+
+/* Where the time and memory go, for the debug overlay and the --stats
+ * report: time per phase summed over the session, keystroke-to-paint
+ * latency and the bytes each table takes. Phases may be timed from any
+ * thread. */
+typedef enum {
+    STATS_READ,         /* opening the file, reading a stream or sidecar */
+    STATS_PARSE,        /* jsmn_parse, or finding JSON Lines records */
+    STATS_INDEX,        /* depths, parents and subtree ends */
+    STATS_LINES,        /* laying out and splicing the visible lines */
+    STATS_SEARCH,       /* from search_start until its workers are done */
+    STATS_RENDER,       /* display_json */
+    STATS_PHASES
+} StatsPhase;
+
+/* Latencies kept for the percentiles; older ones are overwritten */
+#define STATS_MAX_SAMPLES 4096
+/* Width of a report line, NUL included */
+#define STATS_LINE_MAX 64
+#define STATS_MAX_LINES 40
+
+/* Monotonic time in nanoseconds */
+long long stats_now(void);
+
+/* Account the time from start, a stats_now() reading, to one phase */
+void stats_add(StatsPhase phase, long long start);
+
+/* Record the time from a key being read to the screen showing its effect */
+void stats_latency(long long start);
+
+/* The report as lines of text. Call with viewer->lock held. Returns the
+ * number of lines. */
+int stats_report(JsonViewer *viewer, char lines[][STATS_LINE_MAX], int max_lines);
+
+#endif /* STATS_H */
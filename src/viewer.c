@@ -0,0 +1,629 @@
+#include <errno.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bitset.h"
+#include "json_parallel.h"
+#include "json_sidecar.h"
+#include "ndjson.h"
+#include "stats.h"
+#include "viewer.h"
+
+/* Reset everything but the tokenizer input */
+static void viewer_setup(JsonViewer *viewer, const char *json_str, size_t json_len) {
+    viewer->json_str = json_str;
+    viewer->json_len = json_len;
+    viewer->current_line = 0;
+    viewer->scroll_offset = 0;
+    viewer->revision = 0;
+    viewer->search_term[0] = '\0';
+    viewer->search_match_count = 0;
+    viewer->search_covered = -1;
+    viewer->current_match_idx = 0;
+    viewer->current_match_tok = -1;
+    viewer->search_error = NULL;
+    viewer->search_mode = 0;
+    viewer->search = NULL;
+
+    // Every table lives in the arena, placed there by viewer_reserve
+    arena_init(&viewer->arena);
+    viewer->tokens = NULL;
+    viewer->token_count = 0;
+    viewer->token_capacity = 0;
+    viewer->collapsed = NULL;
+    viewer->search_matches = NULL;
+    json_index_borrow(&viewer->index);
+    visible_lines_borrow(&viewer->lines);
+
+    jsmn_init(&viewer->parser);
+    viewer->parsed_len = 0;
+    viewer->chunk_size = LOAD_CHUNK_BYTES;
+    viewer->parallel = 1;
+    viewer->loading = 0;
+    viewer->load_error = 0;
+    viewer->read_errno = 0;
+    viewer->cancel_load = 0;
+    viewer->input_open = 0;
+    viewer->source = NULL;
+    viewer->has_loader = 0;
+    pthread_mutex_init(&viewer->lock, NULL);
+    atomic_init(&viewer->lock_waiters, 0);
+    pthread_cond_init(&viewer->search_idle, NULL);
+    viewer->sidecar_path = NULL;
+    viewer->sidecar_map = NULL;
+    viewer->sidecar_len = 0;
+    viewer->ndjson = NULL;
+}
+
+/* A table laid out in the viewer's arena, sized by the entry capacity */
+typedef struct {
+    const char *name;
+    void **table;
+    size_t elem_size;
+    int per_word;           /* one element per bitset word of entries */
+    int extra;              /* elements past the last entry */
+} ViewerTable;
+
+#define VIEWER_MAX_TABLES 10
+
+static size_t table_size(const ViewerTable *table, int capacity) {
+    size_t n = table->per_word ? BITSET_WORDS(capacity) : (size_t)capacity;
+    return table->elem_size * (n + table->extra);
+}
+
+static void add_table(ViewerTable *tables, int *count, const char *name, void *table,
+                      size_t elem_size, int per_word, int extra) {
+    tables[*count].name = name;
+    tables[*count].table = table;
+    tables[*count].elem_size = elem_size;
+    tables[*count].per_word = per_word;
+    tables[*count].extra = extra;
+    (*count)++;
+}
+
+/* The tables a viewer keeps, which depend on how the document is read */
+static int viewer_tables(JsonViewer *viewer, ViewerTable *tables) {
+    int count = 0;
+
+    add_table(tables, &count, "matches", &viewer->search_matches, sizeof(uint64_t), 1, 0);
+    if (viewer->ndjson) {
+        add_table(tables, &count, "starts", &viewer->ndjson->starts, sizeof(size_t), 0, 1);
+        add_table(tables, &count, "line tree", &viewer->lines.tree, sizeof(int), 1, 1);
+        add_table(tables, &count, "shown", &viewer->lines.shown, sizeof(uint64_t), 1, 0);
+        add_table(tables, &count, "weights", &viewer->lines.weights, sizeof(int), 0, 0);
+        return count;
+    }
+
+    add_table(tables, &count, "collapsed", &viewer->collapsed, sizeof(uint64_t), 1, 0);
+    // A mapped sidecar holds everything else
+    if (viewer->sidecar_map) return count;
+
+    add_table(tables, &count, "tokens", &viewer->tokens, sizeof(jsmntok_t), 0, 0);
+    add_table(tables, &count, "parents", &viewer->index.parents, sizeof(int), 0, 0);
+    add_table(tables, &count, "next", &viewer->index.next, sizeof(int), 0, 0);
+    add_table(tables, &count, "nodes", &viewer->index.nodes, sizeof(uint16_t), 0, 0);
+    add_table(tables, &count, "line tree", &viewer->lines.tree, sizeof(int), 1, 1);
+    add_table(tables, &count, "shown", &viewer->lines.shown, sizeof(uint64_t), 1, 0);
+    return count;
+}
+
+/* Lay out every table in one arena, so they always share one capacity */
+static int viewer_relocate(JsonViewer *viewer, int capacity) {
+    ViewerTable tables[VIEWER_MAX_TABLES];
+    int count = viewer_tables(viewer, tables);
+    size_t size = 0;
+    for (int i = 0; i < count; i++) {
+        size += arena_round(table_size(&tables[i], capacity));
+    }
+
+    Arena arena;
+    if (arena_reserve(&arena, size) < 0) return -1;
+
+    // Fresh arena memory is zeroed, which is what the bitsets need past
+    // the entries copied over
+    int kept = capacity < viewer->token_capacity ? capacity : viewer->token_capacity;
+    for (int i = 0; i < count; i++) {
+        void *table = arena_alloc(&arena, table_size(&tables[i], capacity));
+        if (*tables[i].table) {
+            memcpy(table, *tables[i].table, table_size(&tables[i], kept));
+        }
+        *tables[i].table = table;
+    }
+    arena_free(&viewer->arena);
+    viewer->arena = arena;
+
+    viewer->token_capacity = capacity;
+    viewer->index.capacity = capacity;
+    viewer->lines.capacity = capacity;
+    if (viewer->ndjson) viewer->ndjson->capacity = capacity;
+    return 0;
+}
+
+int viewer_reserve(JsonViewer *viewer, int capacity) {
+    if (capacity <= viewer->token_capacity) return 0;
+    return viewer_relocate(viewer, capacity);
+}
+
+int viewer_shrink(JsonViewer *viewer) {
+    int entries = viewer->ndjson ? viewer->ndjson->count : viewer->token_count;
+    if (entries < 1) entries = 1;
+    if (entries >= viewer->token_capacity) return 0;
+    return viewer_relocate(viewer, entries);
+}
+
+/* Tables count the entries in use; the arena they sit in is reserved
+ * further ahead, mostly as address space */
+int viewer_usage(JsonViewer *viewer, ViewerUsage *usage) {
+    ViewerTable tables[VIEWER_MAX_TABLES];
+    int table_count = viewer_tables(viewer, tables);
+    int entries = viewer->ndjson ? viewer->ndjson->count : viewer->token_count;
+    int count = 0;
+
+    for (int i = 0; i < table_count; i++) {
+        if (!*tables[i].table) continue;
+        usage[count].name = tables[i].name;
+        usage[count++].bytes = table_size(&tables[i], entries);
+    }
+    if (viewer->sidecar_map) {
+        usage[count].name = "sidecar";
+        usage[count++].bytes = viewer->sidecar_len;
+    }
+    usage[count].name = "text";
+    usage[count++].bytes = viewer->source && viewer->source->capacity ? viewer->source->capacity
+                                                                      : viewer->json_len;
+    if (viewer->ndjson) {
+        usage[count].name = "records";
+        usage[count++].bytes = viewer->ndjson->parsed_bytes;
+    }
+    return count;
+}
+
+/* Every token starts on a byte of its own, so a document of known length
+ * never needs more tokens than it has bytes. Reserving that many up front
+ * costs address space rather than memory, and the tables never move. */
+static int initial_capacity(const JsonViewer *viewer) {
+    if (viewer->input_open) return INITIAL_TOKENS;
+    if (viewer->json_len >= JSON_INDEX_MAX_TOKENS) return JSON_INDEX_MAX_TOKENS;
+    return viewer->json_len + 1;
+}
+
+static inline int is_delimiter(char c) {
+    return strchr(" \t\r\n,:[]{}\"", c) != NULL;
+}
+
+/* A chunk may only end right after a delimiter, so that a number or literal
+ * is never split in two. Strings cut short are simply rescanned by jsmn.
+ * While more input is still to come, the chunk instead backs off to the
+ * last delimiter read so far. */
+static size_t chunk_end(const char *js, size_t len, size_t start, size_t end, int more) {
+    if (end >= len) {
+        if (!more) return len;
+        end = len;
+        while (end > start && !is_delimiter(js[end - 1])) {
+            end--;
+        }
+        return end;
+    }
+    while (end < len && !is_delimiter(js[end - 1])) {
+        end++;
+    }
+    return end;
+}
+
+/* Run the tokenizer up to end, growing the tables as it needs. Returns
+ * what jsmn_parse does. */
+static int viewer_tokenize(JsonViewer *viewer, size_t end) {
+    int count;
+
+    // jsmn treats a NULL token array as a request to only count tokens.
+    // Without the address space for the worst case, start small and grow.
+    if (!viewer->tokens && viewer_reserve(viewer, initial_capacity(viewer)) < 0 &&
+        viewer_reserve(viewer, INITIAL_TOKENS) < 0) {
+        return JSMN_ERROR_NOMEM;
+    }
+
+    long long start = stats_now();
+    for (;;) {
+        // Growing the index moves the table jsmn writes its links to
+        viewer->parser.parents = viewer->index.parents;
+        count = jsmn_parse(&viewer->parser, viewer->json_str, end,
+                           viewer->tokens, viewer->token_capacity);
+        if (count != JSMN_ERROR_NOMEM) break;
+
+        // jsmn leaves the parser on the token it could not store, so parsing
+        // resumes where it stopped once there is room again
+        if (viewer->token_capacity > (int)(JSON_INDEX_MAX_TOKENS / 2) ||
+            viewer_reserve(viewer, viewer->token_capacity * 2) < 0) {
+            return JSMN_ERROR_NOMEM;
+        }
+    }
+
+    stats_add(STATS_PARSE, start);
+    return count;
+}
+
+/* Index the tokens added since the last call and lay out their lines */
+static int viewer_publish(JsonViewer *viewer) {
+    viewer->token_count = viewer->parser.toknext;
+    long long start = stats_now();
+    if (json_index_extend(&viewer->index, viewer->tokens, viewer->token_count) < 0) {
+        return JSMN_ERROR_NOMEM;
+    }
+    stats_add(STATS_INDEX, start);
+    start = stats_now();
+    if (visible_lines_extend(&viewer->lines, &viewer->index, viewer->collapsed) < 0) {
+        return JSMN_ERROR_NOMEM;
+    }
+    stats_add(STATS_LINES, start);
+    return 0;
+}
+
+/* Tokenize the next chunk of input and index the new tokens. Returns 1 if
+ * input remains, 0 once the document is complete, or a negative jsmnerr. */
+static int viewer_parse_chunk(JsonViewer *viewer, size_t chunk) {
+    size_t end = chunk_end(viewer->json_str, viewer->json_len, viewer->parsed_len,
+                           viewer->parsed_len + chunk, viewer->input_open);
+    int more = end < viewer->json_len || viewer->input_open;
+
+    // Publish whatever was tokenized, even when the chunk ended in an error
+    int count = viewer_tokenize(viewer, end);
+    if (count == JSMN_ERROR_NOMEM || viewer_publish(viewer) < 0) {
+        return JSMN_ERROR_NOMEM;
+    }
+
+    // Running out of input in the middle of the document is expected
+    // until the last chunk
+    if (count < 0 && !(count == JSMN_ERROR_PART && more)) {
+        return count;
+    }
+
+    // A string longer than the chunk makes no progress and is rescanned
+    // from its opening quote, so widen the window until it fits
+    viewer->chunk_size = (viewer->parser.pos < viewer->parsed_len) ? chunk * 2 : LOAD_CHUNK_BYTES;
+    viewer->parsed_len = end;
+
+    if (more) return 1;
+
+    json_index_finish(&viewer->index);
+    return 0;
+}
+
+/* Tokenize the next round on every core if enough of a mapped document is
+ * left, see json_parallel.h. Only reads the text and the parser, which
+ * the loader alone writes to, so it needs no lock. */
+static JsonRound *viewer_next_round(JsonViewer *viewer) {
+    if (!viewer->parallel || viewer->ndjson || viewer->input_open ||
+        viewer->json_len - viewer->parser.pos < JSON_PARALLEL_MIN_BYTES ||
+        json_parallel_threads() < 2) {
+        return NULL;
+    }
+
+    long long start = stats_now();
+    JsonRound *round = json_round_tokenize(viewer->json_str, viewer->json_len, viewer->parser.pos);
+    stats_add(STATS_PARSE, start);
+
+    // Whatever made the round fail would only make the next one fail too
+    if (!round) viewer->parallel = 0;
+    return round;
+}
+
+/* Stitch a round onto the tokens and index them. A round that does not
+ * fit is dropped for a sequential chunk. Returns like viewer_parse_chunk
+ * and frees the round. */
+static int viewer_parse_round(JsonViewer *viewer, JsonRound *round) {
+    size_t start = json_round_start(round);
+    size_t end = json_round_end(round);
+    size_t count = json_round_tokens(round);
+
+    // The bytes up to the first segment are tokenized as usual
+    int result = viewer_tokenize(viewer, start);
+    if (result == JSMN_ERROR_NOMEM) {
+        json_round_free(round);
+        return result;
+    }
+
+    long long stitch_start = stats_now();
+    int stitched = (result >= 0 || result == JSMN_ERROR_PART) && viewer->parser.pos == start &&
+                   viewer->parser.toknext + count <= JSON_INDEX_MAX_TOKENS &&
+                   viewer_reserve(viewer, viewer->parser.toknext + count) == 0 &&
+                   json_round_stitch(round, &viewer->parser, viewer->tokens,
+                                     viewer->index.parents) == 0;
+    json_round_free(round);
+    viewer->parsed_len = stitched ? end : start;
+    if (!stitched) {
+        viewer->parallel = 0;
+        return viewer_parse_chunk(viewer, viewer->chunk_size);
+    }
+    stats_add(STATS_PARSE, stitch_start);
+
+    if (viewer_publish(viewer) < 0) return JSMN_ERROR_NOMEM;
+    if (end < viewer->json_len) return 1;
+
+    json_index_finish(&viewer->index);
+    return 0;
+}
+
+/* Tokenize a whole document that is already in memory */
+static int viewer_parse_all(JsonViewer *viewer) {
+    int result;
+
+    do {
+        JsonRound *round = viewer_next_round(viewer);
+        result = round ? viewer_parse_round(viewer, round)
+                       : viewer_parse_chunk(viewer, viewer->json_len);
+    } while (result > 0);
+    return result;
+}
+
+int viewer_parse(JsonViewer *viewer, const char *json_str, size_t json_len) {
+    viewer_setup(viewer, json_str, json_len);
+
+    // Offsets past the configured width would silently wrap
+    int result = json_len > (size_t)JSMN_OFFSET_MAX ? JSMN_ERROR_NOMEM : viewer_parse_all(viewer);
+    if (result < 0) {
+        viewer_cleanup(viewer);
+        return result;
+    }
+
+    return 0;
+}
+
+/* Initialize viewer */
+int viewer_init(JsonViewer *viewer, const char *json_str, size_t json_len) {
+    int result = viewer_parse(viewer, json_str, json_len);
+    if (result < 0) {
+        fprintf(stderr, "Failed to parse JSON: %d\n", result);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Catch up with the bytes a stream delivered since the last read, and
+ * make room for the next one. Called with the lock held and no search
+ * running, since growing the buffer may move the text. */
+static int viewer_follow_input(JsonViewer *viewer) {
+    JsonSource *source = viewer->source;
+    viewer->json_len = source->len;
+    viewer->input_open = source->fd >= 0;
+
+    // Records are parsed one at a time and keep their own offsets. How
+    // large a stream is only shows once it is read this far.
+    if (!viewer->ndjson && source->len > (size_t)JSMN_OFFSET_MAX) {
+        return JSON_ERROR_TOO_LARGE;
+    }
+    if (!viewer->input_open) return 0;
+
+    if (json_source_reserve(source, viewer->chunk_size) < 0) {
+        return JSMN_ERROR_NOMEM;
+    }
+    if (viewer->json_str != source->data) {
+        viewer->json_str = source->data;
+        if (viewer->ndjson) ndjson_rebase(viewer);
+    }
+    return 0;
+}
+
+/* Take in the next chunk of input, whichever way the document is read, or
+ * the round tokenized ahead if there is one. Containers still open gain
+ * items, so every line may read differently. */
+static int viewer_load_chunk(JsonViewer *viewer, JsonRound *round) {
+    viewer->revision++;
+    if (round) return viewer_parse_round(viewer, round);
+    if (viewer->input_open) {
+        int result = viewer_follow_input(viewer);
+        if (result < 0) return result;
+    }
+    if (viewer->ndjson) {
+        long long start = stats_now();
+        int result = ndjson_scan_chunk(viewer, viewer->chunk_size);
+        stats_add(STATS_PARSE, start);
+        return result;
+    }
+    return viewer_parse_chunk(viewer, viewer->chunk_size);
+}
+
+static void *loader_main(void *arg) {
+    JsonViewer *viewer = arg;
+    int result;
+    int complete;
+
+    json_source_advise(viewer->source, 1);
+
+    do {
+        // The first chunk goes on its own, so that the first screen shows
+        // up right away
+        JsonRound *round = (viewer->parsed_len > 0 && !viewer->cancel_load)
+                               ? viewer_next_round(viewer) : NULL;
+
+        while (atomic_load(&viewer->lock_waiters) > 0) {
+            sched_yield();
+        }
+        pthread_mutex_lock(&viewer->lock);
+        // Search workers read the token arrays without the lock, so they
+        // must not move underneath them
+        while (viewer->search && !viewer->cancel_load) {
+            pthread_cond_wait(&viewer->search_idle, &viewer->lock);
+        }
+        complete = !viewer->cancel_load;
+        result = complete ? viewer_load_chunk(viewer, round) : 0;
+        if (!complete) json_round_free(round);
+        if (result <= 0) {
+            viewer->load_error = result;
+            viewer->loading = 0;
+        }
+        pthread_mutex_unlock(&viewer->lock);
+
+        // A stream is read without the lock, so that a writer taking its
+        // time never holds up the UI; only the room past json_len is
+        // written to
+        if (result > 0 && viewer->input_open) {
+            long long start = stats_now();
+            ssize_t got = json_source_read(viewer->source, viewer->chunk_size, &viewer->cancel_load);
+            stats_add(STATS_READ, start);
+
+            // The stream is closed by now; what came before the error is
+            // kept, but the document is not taken for complete
+            if (got < 0) {
+                int error = errno;
+                pthread_mutex_lock(&viewer->lock);
+                viewer->read_errno = error;
+                viewer->load_error = result = JSON_ERROR_READ;
+                viewer->loading = 0;
+                pthread_mutex_unlock(&viewer->lock);
+            }
+        }
+    } while (result > 0);
+
+    json_source_advise(viewer->source, 0);
+
+    // Once loading is over the tables no longer move, so they can be
+    // copied out without the lock
+    if (complete && result == 0 && viewer->sidecar_path) {
+        json_sidecar_save(viewer, viewer->sidecar_path);
+    }
+    return NULL;
+}
+
+void viewer_lock(JsonViewer *viewer) {
+    atomic_fetch_add(&viewer->lock_waiters, 1);
+    pthread_mutex_lock(&viewer->lock);
+    atomic_fetch_sub(&viewer->lock_waiters, 1);
+}
+
+void viewer_unlock(JsonViewer *viewer) {
+    pthread_mutex_unlock(&viewer->lock);
+}
+
+/* Run loader_main on a background thread; cleans up on failure */
+static int viewer_spawn_loader(JsonViewer *viewer) {
+    viewer->loading = 1;
+    if (pthread_create(&viewer->loader, NULL, loader_main, viewer) != 0) {
+        viewer->loading = 0;
+        fprintf(stderr, "Cannot start loader thread\n");
+        viewer_cleanup(viewer);
+        return -1;
+    }
+    viewer->has_loader = 1;
+
+    return 0;
+}
+
+/* Start tokenizing on a background thread */
+int viewer_start(JsonViewer *viewer, JsonSource *source, const char *sidecar_path) {
+    viewer_setup(viewer, source->data, source->len);
+    viewer->source = source;
+    viewer->sidecar_path = sidecar_path;
+    viewer->input_open = source->fd >= 0;
+
+    if (source->len > (size_t)JSMN_OFFSET_MAX) {
+        fprintf(stderr, "Failed to parse JSON: %d\n", JSMN_ERROR_NOMEM);
+        viewer_cleanup(viewer);
+        return -1;
+    }
+
+    return viewer_spawn_loader(viewer);
+}
+
+/* Start out in record mode, finding the records on a background thread
+ * for large inputs and streams */
+static int viewer_open_ndjson(JsonViewer *viewer, JsonSource *source, int skeleton) {
+    viewer_setup(viewer, source->data, source->len);
+    viewer->source = source;
+    viewer->input_open = source->fd >= 0;
+
+    if (ndjson_attach(viewer, skeleton) < 0) {
+        fprintf(stderr, "Out of memory\n");
+        viewer_cleanup(viewer);
+        return -1;
+    }
+
+    if (source->len >= PROGRESSIVE_MIN_BYTES || viewer->input_open) {
+        return viewer_spawn_loader(viewer);
+    }
+
+    long long start = stats_now();
+    int result = ndjson_scan_chunk(viewer, source->len);
+    stats_add(STATS_PARSE, start);
+    if (result < 0) {
+        fprintf(stderr, "Failed to index records: %d\n", result);
+        viewer_cleanup(viewer);
+        return -1;
+    }
+    return 0;
+}
+
+int viewer_open_records(JsonViewer *viewer, JsonSource *source) {
+    return viewer_open_ndjson(viewer, source, 0);
+}
+
+int viewer_open_skeleton(JsonViewer *viewer, JsonSource *source) {
+    return viewer_open_ndjson(viewer, source, 1);
+}
+
+int viewer_open_sidecar(JsonViewer *viewer, JsonSource *source, const char *sidecar_path) {
+    viewer_setup(viewer, source->data, source->len);
+    viewer->source = source;
+
+    long long start = stats_now();
+    if (json_sidecar_map(viewer, sidecar_path) < 0) {
+        viewer_cleanup(viewer);
+        return -1;
+    }
+    stats_add(STATS_READ, start);
+    return 0;
+}
+
+int viewer_wait(JsonViewer *viewer) {
+    if (viewer->has_loader) {
+        pthread_join(viewer->loader, NULL);
+        viewer->has_loader = 0;
+    }
+    return viewer->load_error;
+}
+
+void viewer_cleanup(JsonViewer *viewer) {
+    if (viewer->has_loader) {
+        viewer_lock(viewer);
+        viewer->cancel_load = 1;
+        pthread_cond_broadcast(&viewer->search_idle);
+        viewer_unlock(viewer);
+        pthread_join(viewer->loader, NULL);
+        viewer->has_loader = 0;
+    }
+    json_sidecar_unmap(viewer);
+    ndjson_detach(viewer);
+    viewer->source = NULL;
+    viewer->sidecar_path = NULL;
+
+    viewer->json_str = NULL;
+    visible_lines_free(&viewer->lines);
+    json_index_free(&viewer->index);
+    arena_free(&viewer->arena);
+    viewer->tokens = NULL;
+    viewer->collapsed = NULL;
+    viewer->search_matches = NULL;
+    viewer->token_count = viewer->token_capacity = 0;
+    pthread_mutex_destroy(&viewer->lock);
+    pthread_cond_destroy(&viewer->search_idle);
+}
+
+/* Collapse or expand a container */
+int set_collapsed(JsonViewer *viewer, int tok_idx, int collapsed) {
+    if (!is_container(&viewer->index, tok_idx)) return 0;
+    if (bitset_test(viewer->collapsed, tok_idx) == collapsed) return 0;
+
+    long long start = stats_now();
+    viewer->revision++;
+    if (collapsed) {
+        bitset_set(viewer->collapsed, tok_idx);
+        visible_lines_collapse(&viewer->lines, &viewer->index, viewer->collapsed, tok_idx);
+    } else {
+        bitset_clear(viewer->collapsed, tok_idx);
+        visible_lines_expand(&viewer->lines, &viewer->index, viewer->collapsed, tok_idx);
+    }
+    stats_add(STATS_LINES, start);
+    return 1;
+}
@@ -0,0 +1,153 @@
+#ifndef VIEWER_H
+#define VIEWER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "json_index.h"
+#include "json_source.h"
+#include "visible_lines.h"
+
+#define FREE_PTR( x ) { free(x); x=0; }
+
+#define MAX_SEARCH_LEN 256
+
+/* Inputs at least this large are tokenized on a background thread while
+ * the UI already shows the tokens parsed so far */
+#define PROGRESSIVE_MIN_BYTES (16 << 20)
+/* Bytes tokenized per step of a progressive load */
+#define LOAD_CHUNK_BYTES (1 << 20)
+/* load_error when reading a stream failed, next to jsmn's own errors */
+#define JSON_ERROR_READ (-16)
+/* load_error when a stream grew past the offsets of this build, see
+ * JSMN_OFFSET_MAX; the wide-offset build reads it */
+#define JSON_ERROR_TOO_LARGE (-17)
+
+struct SearchJob;
+struct NdjsonIndex;
+
+typedef struct {
+    Arena arena;            /* owns every per-token (or per-record) table */
+    jsmntok_t *tokens;
+    int token_count;
+    int token_capacity;
+    const char *json_str;   /* borrowed from the caller, not NUL-terminated */
+    size_t json_len;
+    int current_line;
+    int scroll_offset;
+    VisibleLines lines;
+    uint64_t *collapsed;        /* bitset, one bit per collapsed container */
+    JsonIndex index;
+    int max_y, max_x;
+    unsigned int revision;      /* changes whenever the text of a line may */
+    char search_term[MAX_SEARCH_LEN];
+    uint64_t *search_matches;   /* bitset, one bit per matching token */
+    int search_match_count;
+    int search_covered;         /* units the matches are complete for, or -1 */
+    int current_match_idx;
+    int current_match_tok;      /* token of the current match, or -1 */
+    const char *search_error;   /* why the search term is invalid, or NULL */
+    int search_mode;
+    struct SearchJob *search;   /* in-flight search, or NULL */
+
+    /* Resumable tokenizer state. While loading, every field above that
+     * depends on the tokens is only touched with lock held. */
+    jsmn_parser parser;
+    size_t parsed_len;      /* bytes handed to the tokenizer so far */
+    size_t chunk_size;
+    int parallel;           /* 0 once a parallel round failed, see json_parallel.h */
+    int loading;            /* 1 while the background parser runs */
+    int load_error;         /* jsmnerr that stopped the parse, JSON_ERROR_*, or 0 */
+    int read_errno;         /* why reading a stream failed */
+    int cancel_load;
+    int input_open;         /* 1 while json_str is a stream still being read */
+    JsonSource *source;     /* advised about access patterns, may be NULL */
+    int has_loader;
+    pthread_t loader;
+    pthread_mutex_t lock;
+    atomic_int lock_waiters;
+    pthread_cond_t search_idle; /* signalled when a search finishes */
+
+    /* Index sidecar: where to save it once parsed, and the mapping the
+     * tables point into when it was loaded instead of parsing */
+    const char *sidecar_path;
+    void *sidecar_map;
+    size_t sidecar_len;
+
+    /* JSON Lines mode: lines, search_matches and the loader then deal in
+     * records rather than tokens, and tokens is unused. NULL otherwise. */
+    struct NdjsonIndex *ndjson;
+} JsonViewer;
+
+/* Parse the whole document before returning */
+int viewer_init(JsonViewer *viewer, const char *json_str, size_t json_len);
+
+/* viewer_init without the error message. Returns 0, or a negative jsmnerr
+ * with nothing to clean up. */
+int viewer_parse(JsonViewer *viewer, const char *json_str, size_t json_len);
+
+/* Return right away and tokenize on a background thread; the token arrays
+ * grow under viewer->lock one chunk at a time. A source that is a stream
+ * is read on the same thread, ahead of the tokenizer, and json_str and
+ * json_len follow it as it grows. A complete parse is saved to
+ * sidecar_path unless it is NULL. */
+int viewer_start(JsonViewer *viewer, JsonSource *source, const char *sidecar_path);
+
+/* Show a mapped file using the index saved by an earlier viewer_start.
+ * Returns -1, with nothing to clean up, if the sidecar is missing or
+ * stale. */
+int viewer_open_sidecar(JsonViewer *viewer, JsonSource *source, const char *sidecar_path);
+
+/* Show a JSON Lines document, one value per line, as a list of records
+ * that are parsed one by one as they are expanded. Only the line breaks
+ * are scanned up front, on a background thread for large inputs. */
+int viewer_open_records(JsonViewer *viewer, JsonSource *source);
+
+/* Show any document's top-level array or object that way, a member to a
+ * record. Only its brackets are matched up front, and a member is
+ * tokenized once it is expanded. */
+int viewer_open_skeleton(JsonViewer *viewer, JsonSource *source);
+
+/* Wait for the background load, if any, to end. Returns 0 once the whole
+ * input is in, or the negative jsmnerr that stopped it, or JSON_ERROR_READ
+ * if reading a stream failed, with the errno in viewer->read_errno, or
+ * JSON_ERROR_TOO_LARGE if a stream outgrew this build. */
+int viewer_wait(JsonViewer *viewer);
+
+void viewer_cleanup(JsonViewer *viewer);
+
+/* Make room for capacity tokens, or records in JSON Lines mode, in every
+ * table. All of them are laid out together in a new arena, the contents
+ * copied over and the old arena freed in one go. Returns 0 or -1. */
+int viewer_reserve(JsonViewer *viewer, int capacity);
+
+/* Move the tables of a document that is done loading into an arena just
+ * large enough for the entries in use. Returns 0, or -1 with the tables
+ * left where they were. */
+int viewer_shrink(JsonViewer *viewer);
+
+/* Memory one part of a document takes up */
+typedef struct {
+    const char *name;
+    size_t bytes;
+} ViewerUsage;
+
+#define VIEWER_MAX_USAGE 16
+
+/* Bytes set aside for each table, the text and whatever else the document
+ * holds, for the stats report. Returns the number of entries. */
+int viewer_usage(JsonViewer *viewer, ViewerUsage *usage);
+
+/* Take and release viewer->lock from the UI thread. The loader backs off
+ * between chunks while someone is waiting, so redraws are never starved. */
+void viewer_lock(JsonViewer *viewer);
+void viewer_unlock(JsonViewer *viewer);
+
+/* Collapse or expand a container, splicing only its subtree in or out of the
+ * visible lines. Returns 1 if the layout changed. */
+int set_collapsed(JsonViewer *viewer, int tok_idx, int collapsed);
+
+#endif /* VIEWER_H */
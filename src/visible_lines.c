@@ -0,0 +1,259 @@
+#include <stdlib.h>
+
+#include "bitset.h"
+#include "visible_lines.h"
+
+/* Lines one entry owns while it is shown */
+static inline int entry_lines(const VisibleLines *lines, int entry) {
+    return lines->weights ? lines->weights[entry] : 1;
+}
+
+/* Add delta to the line count of one block */
+static void fenwick_add(VisibleLines *lines, int block, int delta) {
+    for (int i = block + 1; i <= lines->blocks; i += i & -i) {
+        lines->tree[i] += delta;
+    }
+    lines->total += delta;
+}
+
+static void set_shown(VisibleLines *lines, int token_idx, int shown) {
+    if (bitset_test(lines->shown, token_idx) == shown) return;
+    if (shown) {
+        bitset_set(lines->shown, token_idx);
+    } else {
+        bitset_clear(lines->shown, token_idx);
+    }
+    int n = entry_lines(lines, token_idx);
+    fenwick_add(lines, token_idx >> 6, shown ? n : -n);
+}
+
+/* A token gets a line when its container is shown and expanded; values
+ * drawn inline with their key never do. Only the first top-level value is
+ * laid out. No collapsed table means everything is expanded. */
+static int starts_shown(const VisibleLines *lines, const JsonIndex *index,
+                        const uint64_t *collapsed, int token_idx) {
+    int p = index->parents[token_idx];
+
+    if (is_inline_value(index, token_idx)) return 0;
+    if (p < 0) return token_idx == 0;
+    return bitset_test(lines->shown, p) && !(collapsed && bitset_test(collapsed, p));
+}
+
+/* Add an entry after the last one. The first entry of a word opens a new
+ * block, whose Fenwick node covers a range ending at the block itself, so
+ * it can be filled in as soon as every block before it is known. */
+static void append_entry(VisibleLines *lines, int shown) {
+    int i = lines->count;
+    int block = i >> 6;
+
+    if ((i & 63) == 0) {
+        int j = block + 1;
+        int node = 0;
+        for (int k = j - 1; k > j - (j & -j); k -= k & -k) {
+            node += lines->tree[k];
+        }
+        lines->tree[j] = node;
+        lines->shown[block] = 0;
+        lines->blocks = j;
+        while (lines->top_bit * 2 <= lines->blocks) {
+            lines->top_bit *= 2;
+        }
+    }
+
+    lines->count = i + 1;
+    if (shown) {
+        bitset_set(lines->shown, i);
+        fenwick_add(lines, block, entry_lines(lines, i));
+    }
+}
+
+static void clear(VisibleLines *lines) {
+    lines->count = 0;
+    lines->capacity = 0;
+    lines->total = 0;
+    lines->blocks = 0;
+    lines->top_bit = 1;
+    lines->tree = NULL;
+    lines->shown = NULL;
+    lines->weights = NULL;
+    lines->borrowed = 0;
+}
+
+/* Lay out the lines of the document rooted at token 0 */
+int visible_lines_init(VisibleLines *lines, const JsonIndex *index,
+                       const uint64_t *collapsed) {
+    clear(lines);
+    if (visible_lines_reserve(lines, index->count) < 0) {
+        visible_lines_free(lines);
+        return -1;
+    }
+
+    return visible_lines_extend(lines, index, collapsed);
+}
+
+void visible_lines_borrow(VisibleLines *lines) {
+    clear(lines);
+    lines->borrowed = 1;
+}
+
+int visible_lines_reserve(VisibleLines *lines, int capacity) {
+    if (capacity <= lines->capacity && (lines->tree || lines->borrowed)) return 0;
+    if (lines->borrowed) return -1;
+
+    size_t words = BITSET_WORDS(capacity);
+    int *tree = realloc(lines->tree, sizeof(int) * (words + 1));
+    if (!tree) return -1;
+    lines->tree = tree;
+
+    uint64_t *shown = realloc(lines->shown, sizeof(uint64_t) * (words > 0 ? words : 1));
+    if (!shown) return -1;
+    lines->shown = shown;
+
+    if (lines->weights) {
+        int *weights = realloc(lines->weights, sizeof(int) * (capacity > 0 ? capacity : 1));
+        if (!weights) return -1;
+        lines->weights = weights;
+    }
+
+    lines->capacity = capacity;
+    return 0;
+}
+
+/* Append the tokens indexed since the last call */
+int visible_lines_extend(VisibleLines *lines, const JsonIndex *index,
+                         const uint64_t *collapsed) {
+    int count = index->count;
+    if (visible_lines_reserve(lines, count) < 0) return -1;
+
+    for (int i = lines->count; i < count; i++) {
+        append_entry(lines, starts_shown(lines, index, collapsed, i));
+    }
+    return 0;
+}
+
+int visible_lines_append(VisibleLines *lines, int count) {
+    if (visible_lines_reserve(lines, count) < 0) return -1;
+
+    // Entries laid out so far owned one line each
+    if (!lines->weights) {
+        if (lines->borrowed) return -1;
+        lines->weights = malloc(sizeof(int) * (lines->capacity > 0 ? lines->capacity : 1));
+        if (!lines->weights) return -1;
+        for (int i = 0; i < lines->count; i++) {
+            lines->weights[i] = 1;
+        }
+    }
+
+    for (int i = lines->count; i < count; i++) {
+        lines->weights[i] = 1;
+        append_entry(lines, 1);
+    }
+    return 0;
+}
+
+void visible_lines_free(VisibleLines *lines) {
+    if (!lines->borrowed) {
+        free(lines->tree);
+        free(lines->shown);
+        free(lines->weights);
+    }
+    clear(lines);
+}
+
+/* Token shown on the given line, or -1 if out of range */
+int visible_lines_token(const VisibleLines *lines, int line) {
+    if (line < 0 || line >= lines->total) return -1;
+
+    // Descend to the last block boundary whose prefix sum is <= line; the
+    // block right after it holds the line
+    int block = 0;
+    int remaining = line;
+    for (int step = lines->top_bit; step > 0; step >>= 1) {
+        int next = block + step;
+        if (next <= lines->blocks && lines->tree[next] <= remaining) {
+            block = next;
+            remaining -= lines->tree[next];
+        }
+    }
+
+    // Then count off the shown entries of that block
+    uint64_t word = lines->shown[block];
+    if (!lines->weights) {
+        for (; remaining > 0; remaining--) {
+            word &= word - 1;
+        }
+        return (block << 6) + __builtin_ctzll(word);
+    }
+    for (;;) {
+        int entry = (block << 6) + __builtin_ctzll(word);
+        if (remaining < lines->weights[entry]) return entry;
+        remaining -= lines->weights[entry];
+        word &= word - 1;
+    }
+}
+
+/* Lines owned by the entries [0, end) */
+static int prefix(const VisibleLines *lines, int end) {
+    int sum = 0;
+    int block = end >> 6;
+
+    for (int i = block; i > 0; i -= i & -i) {
+        sum += lines->tree[i];
+    }
+    if (end & 63) {
+        uint64_t word = lines->shown[block] & ~(~(uint64_t)0 << (end & 63));
+        if (!lines->weights) return sum + __builtin_popcountll(word);
+        for (; word; word &= word - 1) {
+            sum += lines->weights[(block << 6) + __builtin_ctzll(word)];
+        }
+    }
+    return sum;
+}
+
+/* Line of the given token; a hidden token maps to the closest line above it */
+int visible_lines_line(const VisibleLines *lines, int token_idx) {
+    int sum = prefix(lines, token_idx + 1);
+    return sum > 0 ? sum - 1 : 0;
+}
+
+int visible_lines_start(const VisibleLines *lines, int entry) {
+    return prefix(lines, entry);
+}
+
+void visible_lines_resize(VisibleLines *lines, int entry, int line_count) {
+    int current = lines->weights[entry];
+    lines->weights[entry] = line_count;
+    if (line_count != current && bitset_test(lines->shown, entry)) {
+        fenwick_add(lines, entry >> 6, line_count - current);
+    }
+}
+
+/* Hide every line below a container that is being collapsed */
+void visible_lines_collapse(VisibleLines *lines, const JsonIndex *index,
+                            const uint64_t *collapsed, int token_idx) {
+    if (!bitset_test(lines->shown, token_idx)) return;
+
+    int end = skip_token(index, token_idx);
+    int i = token_idx + 1;
+    while (i < end) {
+        set_shown(lines, i, 0);
+        // Below an already collapsed container nothing is shown
+        i = bitset_test(collapsed, i) ? skip_token(index, i) : i + 1;
+    }
+}
+
+/* Reveal the lines below a container that is being expanded, keeping
+ * nested collapsed containers closed */
+void visible_lines_expand(VisibleLines *lines, const JsonIndex *index,
+                          const uint64_t *collapsed, int token_idx) {
+    if (!bitset_test(lines->shown, token_idx)) return;
+
+    int end = skip_token(index, token_idx);
+    int i = token_idx + 1;
+    while (i < end) {
+        if (!is_inline_value(index, i)) {
+            set_shown(lines, i, 1);
+        }
+        i = bitset_test(collapsed, i) ? skip_token(index, i) : i + 1;
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef VISIBLE_LINES_H
+#define VISIBLE_LINES_H
+
+#include <stdint.h>
+
+#include "json_index.h"
+
+/* Flattened list of the tokens that currently own a screen line: a bitset
+ * of shown tokens under a Fenwick tree of per-block line counts, one block
+ * per bitset word. Mapping a line to its token and back is O(log n) plus a
+ * scan of one word; collapsing or expanding a node touches only the lines
+ * it hides or reveals. */
+typedef struct {
+    int count;              /* tokens covered */
+    int capacity;
+    int total;              /* visible lines */
+    int blocks;             /* bitset words covered */
+    int top_bit;            /* highest power of two <= blocks, for descents */
+    int *tree;              /* Fenwick tree over blocks, 1-based */
+    uint64_t *shown;        /* bitset of the tokens that have their own line */
+    int *weights;           /* lines of each entry when not all own one, or NULL */
+    int borrowed;           /* tables belong to the caller, see visible_lines_borrow */
+} VisibleLines;
+
+/* Lay out the lines of the document rooted at token 0. Returns 0, or -1 if
+ * out of memory. */
+int visible_lines_init(VisibleLines *lines, const JsonIndex *index,
+                       const uint64_t *collapsed);
+void visible_lines_free(VisibleLines *lines);
+
+/* Start out empty on tables the caller places itself, as with
+ * json_index_borrow. The caller sets tree, shown, weights if entries are
+ * to carry them, and capacity. */
+void visible_lines_borrow(VisibleLines *lines);
+
+/* Grow the list for a document that is still being parsed: extend lays out
+ * the tokens from lines->count up to index->count in O(log n) each. */
+int visible_lines_reserve(VisibleLines *lines, int capacity);
+int visible_lines_extend(VisibleLines *lines, const JsonIndex *index,
+                         const uint64_t *collapsed);
+
+/* Entries need not be tokens, nor own a single line each: a JSON Lines
+ * document is laid out with one entry per record, which owns as many
+ * lines as the record shows. append adds entries up to count with one
+ * line each, resize changes the lines of one entry and start gives the
+ * first of them. Entries laid out this way carry weights. */
+int visible_lines_append(VisibleLines *lines, int count);
+void visible_lines_resize(VisibleLines *lines, int entry, int line_count);
+int visible_lines_start(const VisibleLines *lines, int entry);
+
+/* Token shown on the given line, or -1 if out of range */
+int visible_lines_token(const VisibleLines *lines, int line);
+
+/* Line of the given token; a hidden token maps to the closest line above it */
+int visible_lines_line(const VisibleLines *lines, int token_idx);
+
+/* Splice a container's subtree out of / into the list. Call after updating
+ * the token's bit in collapsed; nothing changes unless the token itself is
+ * shown. */
+void visible_lines_collapse(VisibleLines *lines, const JsonIndex *index,
+                            const uint64_t *collapsed, int token_idx);
+void visible_lines_expand(VisibleLines *lines, const JsonIndex *index,
+                          const uint64_t *collapsed, int token_idx);
+
+#endif /* VISIBLE_LINES_H */